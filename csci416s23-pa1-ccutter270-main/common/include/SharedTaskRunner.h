@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Process-wide pool of worker threads shared by C++ code and ISPC task launches
+ *
+ * The pool is created on first use with one worker per online processor, less one for the thread
+ * that launches tasks (it executes queued tasks while it waits). When common/tasksys.cc is built
+ * with ISPC_USE_TASKRUNNER ISPC `launch` statements run on this same pool, so programs that mix
+ * ISPC kernels with C++ parallel stages don't oversubscribe the machine with two sets of threads.
+ */
+class SharedTaskRunner {
+ public:
+  /**
+   * @brief Task entry point, with the same leading arguments as ISPC task functions
+   */
+  typedef void (*TaskFunction)(void *data, int threadIndex, int threadCount, int taskIndex,
+                               int taskCount);
+
+  /**
+   * @brief Set of launches that are waited on together
+   */
+  struct Group {
+    std::atomic<int> numUnfinished{0};
+  };
+
+  /**
+   * @brief The pool, created on first use
+   */
+  static SharedTaskRunner &Instance();
+
+  /**
+   * @brief Number of threads that can execute tasks concurrently (the workers plus one caller)
+   */
+  int NumThreads() const { return static_cast<int>(workers.size()) + 1; }
+
+  /**
+   * @brief Queue fn(data, ..., taskIndex, count) for each taskIndex in [0, count) as part of group
+   */
+  void Launch(Group *group, TaskFunction fn, void *data, int count);
+
+  /**
+   * @brief Wait for all of group's tasks to complete, executing queued tasks in the meantime
+   */
+  void Wait(Group *group);
+
+  /**
+   * @brief Execute fn(taskIndex, count) for each taskIndex in [0, count), returning once all of them
+   * have completed
+   *
+   * fn is called through a pointer to the caller's object rather than copied into a std::function, so
+   * running a lambda doesn't allocate.
+   */
+  template <typename Fn>
+  void Run(int count, const Fn &fn) {
+    Group group;
+    Launch(&group, &RunFunction<Fn>, const_cast<Fn *>(&fn), count);
+    Wait(&group);
+  }
+
+ private:
+  struct QueuedLaunch {
+    Group *group;
+    TaskFunction fn;
+    void *data;
+    int count;
+    int next;  // Next task to claim
+  };
+
+  template <typename Fn>
+  static void RunFunction(void *data, int threadIndex, int threadCount, int taskIndex,
+                          int taskCount) {
+    (*static_cast<const Fn *>(data))(taskIndex, taskCount);
+  }
+
+  explicit SharedTaskRunner(int numWorkers);
+
+  /**
+   * @brief Append to the queue, growing it if it is full, queueMutex must be held
+   */
+  void PushLocked(const QueuedLaunch &launch);
+
+  void WorkerLoop(int threadIndex);
+
+  /**
+   * @brief Claim and execute a chunk of the oldest queued launch, lock is held on entry and exit
+   * @return false if there were no queued tasks
+   */
+  bool RunChunkLocked(std::unique_lock<std::mutex> &lock, int threadIndex);
+
+  std::vector<std::thread> workers;
+  std::mutex queueMutex;
+  std::condition_variable workCond;  // Tasks were queued
+  std::condition_variable doneCond;  // A group's last task completed
+  // Ring of queued launches that only grows (doubling) when it is full, so steady-state launches
+  // don't allocate
+  std::vector<QueuedLaunch> queue;
+  size_t queueHead = 0;  // Oldest launch
+  size_t queueSize = 0;
+};
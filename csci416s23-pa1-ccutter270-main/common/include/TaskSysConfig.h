@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+
+/**
+ * @brief Thread placement for the ISPC task system (common/tasksys.cc) and SharedTaskRunner
+ *
+ * Unset fields are taken from the environment, then from the machine's topology:
+ *
+ *   ISPC_NUM_THREADS     Threads that execute tasks, including the thread that launches them.
+ *                        Defaults to one per usable CPU, capped by the cgroup CPU quota.
+ *   ISPC_CPUS            CPUs to run on as a list such as "0-3,8". Defaults to the process's
+ *                        affinity mask, so cpuset-limited containers only see their own CPUs.
+ *   ISPC_SMT             1 to use every hardware thread, 0 for one thread per physical core
+ *                        (from /sys/devices/system/cpu/cpu<N>/topology). Defaults to 1.
+ *   ISPC_MAX_LIVE_TASKS  Launches in flight at once, ISPC_USE_PTHREADS_FULLY_SUBSCRIBED only.
+ *   ISPC_DISPATCH        Initial TaskDispatch: "linear" (the default), "morton" or "hilbert".
+ *
+ * Worker threads are pinned to CPUs when ISPC_CPUS or ISPC_SMT=0 restrict the placement (the
+ * fully-subscribed backend always pins), otherwise they float within the affinity mask.
+ */
+struct TaskSysConfig {
+  int numThreads = 0;    // 0 for the default
+  std::string cpus;      // Empty for the default
+  int smt = -1;          // -1 for the default
+  int maxLiveTasks = 0;  // 0 for the default
+};
+
+/**
+ * @brief Set the placement, overriding the environment; must be called before the first launch
+ * @return false if the task system's threads have already been created, in which case nothing
+ * changes
+ */
+bool ConfigureTaskSys(const TaskSysConfig& config);
+
+/**
+ * @brief The placement in effect, resolving it if no launch has done so yet
+ */
+TaskSysConfig GetTaskSysConfig();
+
+/**
+ * @brief Name of the task model the task system was compiled with, such as "pthreads" or
+ * "taskrunner", so timings can be attributed to it
+ */
+const char *GetTaskSysBackend();
+
+/**
+ * @brief Order in which the tasks of a multi-dimensional launch (launch[x, y] or launch[x, y, z])
+ * are handed out to the workers
+ *
+ * The curves keep the tasks that run at the same time, and the consecutive tasks that a worker
+ * claims as a chunk, in a compact block of the grid rather than a few long rows, so tiled kernels
+ * share the neighbouring data they touch in cache. Tasks keep their own taskIndex0/1/2, only the
+ * order changes. Ignored by ISPC_USE_PTHREADS_FULLY_SUBSCRIBED.
+ */
+enum class TaskDispatch {
+  kLinear,   // taskIndex order, one row after another
+  kMorton,   // Z-order curve
+  kHilbert,  // Hilbert curve for 2D grids, Z-order for 3D ones
+};
+
+/**
+ * @brief Set the order for subsequent launches, may be called at any time
+ */
+void SetTaskDispatch(TaskDispatch dispatch);
+
+TaskDispatch GetTaskDispatch();
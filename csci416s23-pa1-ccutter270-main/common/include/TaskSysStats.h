@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Counters for the ISPC task system (common/tasksys.cc) and SharedTaskRunner
+ *
+ * Task groups, their argument memory and the runner's queue are recycled, so once a launch loop has
+ * warmed up heapAllocations should stop growing.
+ */
+struct TaskSysStats {
+  int64_t launches;         // ISPCLaunch calls
+  int64_t heapAllocations;  // Heap allocations made by the task system
+  int64_t heapBytes;        // Total size of those allocations
+};
+
+/**
+ * @brief Counters accumulated since the start of the program or the last ResetTaskSysStats
+ */
+TaskSysStats GetTaskSysStats();
+
+void ResetTaskSysStats();
@@ -47,6 +47,8 @@
     - TBB (ISPC_USE_TBB_TASK_GROUP, ISPC_USE_TBB_PARALLEL_FOR)
     - OpenMP (ISPC_USE_OMP)
     - HPX (ISPC_USE_HPX)
+    - the thread pool shared with C++ code in SharedTaskRunner.h
+      (ISPC_USE_TASKRUNNER)
 
   The task system implementation can be selected at compile time, by defining
   the appropriate preprocessor symbol on the command line (for e.g.: -D
@@ -70,19 +72,30 @@ on the machine.
 
 #define ISPC_USE_CREW
 #define ISPC_USE_HPX
+#define ISPC_USE_TASKRUNNER
   The HPX model requires the HPX runtime environment to be set up. This can be
   done manually, e.g. with hpx::init, or by including hpx/hpx_main.hpp which
   uses the main() function as entry point and sets up the runtime system.
   Number of threads can be specified as commandline parameter with
   --hpx:threads, use "all" to spawn one thread per processing unit.
 
+  The ISPC_USE_TASKRUNNER model runs tasks on SharedTaskRunner, a process-wide
+pool that C++ code can also launch tasks on, so that ISPC kernels and C++
+parallel stages share one set of threads.
+
+  The pthreads models and SharedTaskRunner size and place their threads from
+ConfigureTaskSys() or the ISPC_NUM_THREADS, ISPC_CPUS, ISPC_SMT and
+ISPC_MAX_LIVE_TASKS environment variables, falling back to the process's
+affinity mask, cgroup CPU quota and SMT topology (see TaskSysConfig.h).
+
 */
 
 #if !(defined ISPC_USE_CONCRT || defined ISPC_USE_GCD ||                      \
       defined ISPC_USE_PTHREADS ||                                            \
       defined ISPC_USE_PTHREADS_FULLY_SUBSCRIBED ||                           \
       defined ISPC_USE_TBB_TASK_GROUP || defined ISPC_USE_TBB_PARALLEL_FOR || \
-      defined ISPC_USE_OMP || defined ISPC_USE_HPX)
+      defined ISPC_USE_OMP || defined ISPC_USE_HPX ||                         \
+      defined ISPC_USE_TASKRUNNER)
 
 // If no task model chosen from the compiler cmdline, pick a reasonable default
 #if defined(_WIN32) || defined(_WIN64)
@@ -120,7 +133,7 @@ using namespace Concurrency;
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
-#include <semaphore.h>
+#include <sched.h>
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -140,7 +153,6 @@ using namespace Concurrency;
 #include <algorithm>
 #include <vector>
 //#include <stdexcept>
-#include <stack>
 #endif  // ISPC_USE_PTHREADS_FULLY_SUBSCRIBED
 #ifdef ISPC_USE_TBB_PARALLEL_FOR
 #include <tbb/parallel_for.h>
@@ -157,6 +169,8 @@ using namespace Concurrency;
 #endif  // ISPC_USE_HPX
 #ifdef ISPC_IS_LINUX
 #include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
 #endif  // ISPC_IS_LINUX
 
 #include <assert.h>
@@ -166,6 +180,12 @@ using namespace Concurrency;
 #include <string.h>
 #include <algorithm>
 
+#include <atomic>
+
+#include "SharedTaskRunner.h"
+#include "TaskSysConfig.h"
+#include "TaskSysStats.h"
+
 // Signature of ispc-generated 'task' functions
 typedef void (*TaskFuncType)(void *data, int threadIndex, int threadCount,
                              int taskIndex, int taskCount, int taskIndex0,
@@ -205,6 +225,361 @@ void *ISPCAlloc(void **handlePtr, int64_t size, int32_t alignment);
 void ISPCSync(void *handle);
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Statistics
+
+static std::atomic<int64_t> lNumLaunches(0);
+static std::atomic<int64_t> lNumHeapAllocations(0);
+static std::atomic<int64_t> lNumHeapBytes(0);
+
+static inline void lCountLaunch() {
+  lNumLaunches.fetch_add(1, std::memory_order_relaxed);
+}
+
+static inline void lCountHeapAllocation(int64_t size) {
+  lNumHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+  lNumHeapBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+TaskSysStats GetTaskSysStats() {
+  TaskSysStats stats;
+  stats.launches = lNumLaunches.load(std::memory_order_relaxed);
+  stats.heapAllocations = lNumHeapAllocations.load(std::memory_order_relaxed);
+  stats.heapBytes = lNumHeapBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void ResetTaskSysStats() {
+  lNumLaunches.store(0, std::memory_order_relaxed);
+  lNumHeapAllocations.store(0, std::memory_order_relaxed);
+  lNumHeapBytes.store(0, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Thread placement
+//
+// Resolved once, when the first backend creates its threads, from
+// ConfigureTaskSys(), the ISPC_* environment variables and the machine's
+// topology (see TaskSysConfig.h).
+
+#define DEFAULT_MAX_LIVE_TASKS 1024
+
+struct Placement {
+  int numThreads;        // Including the launching thread
+  std::vector<int> cpus; // Usable CPUs, distinct physical cores first
+  bool pin;              // Whether workers are pinned to cpus
+  int smt;
+  int maxLiveTasks;
+};
+
+static std::mutex placementMutex;
+static TaskSysConfig requestedConfig;
+static Placement *placement = NULL;
+
+/* Parse a CPU list such as "0-3,8" (the format of the kernel's *_list
+   files) into cpus, returning false if it is malformed.
+ */
+static bool lParseCpuList(const char *str, std::vector<int> *cpus) {
+  const char *p = str;
+  while (*p != '\0' && *p != '\n') {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p || first < 0) return false;
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1 || last < first) return false;
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; ++cpu) cpus->push_back(int(cpu));
+    if (*p == ',') ++p;
+    else if (*p != '\0' && *p != '\n') return false;
+  }
+  return true;
+}
+
+static std::string lFormatCpuList(std::vector<int> cpus) {
+  std::sort(cpus.begin(), cpus.end());
+  std::string str;
+  for (size_t i = 0; i < cpus.size();) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+    if (!str.empty()) str += ",";
+    str += std::to_string(cpus[i]);
+    if (j > i) str += "-" + std::to_string(cpus[j]);
+    i = j + 1;
+  }
+  return str;
+}
+
+static bool lReadLine(const char *path, char *buf, int size) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) return false;
+  bool ok = fgets(buf, size, file) != NULL;
+  fclose(file);
+  return ok;
+}
+
+/* Lowest-numbered hardware thread on the same physical core as cpu, or cpu
+   itself if the topology isn't available.
+ */
+static int lCoreOf(int cpu) {
+  char path[128], buf[256];
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+  std::vector<int> siblings;
+  if (!lReadLine(path, buf, sizeof(buf)) || !lParseCpuList(buf, &siblings) ||
+      siblings.empty())
+    return cpu;
+  return *std::min_element(siblings.begin(), siblings.end());
+}
+
+/* CPUs' worth of time the process's cgroup may use (rounded up), or 0 if
+   it isn't limited.  Checks cgroup v2's cpu.max and then v1's CFS quota.
+ */
+static int lCgroupCpuLimit() {
+  char buf[256];
+  long long quota = -1, period = 0;
+
+  std::string dir = "/sys/fs/cgroup";
+  if (lReadLine("/proc/self/cgroup", buf, sizeof(buf)) &&
+      strncmp(buf, "0::", 3) == 0) {
+    dir += std::string(buf + 3);
+    if (!dir.empty() && dir.back() == '\n') dir.pop_back();
+  }
+  if (lReadLine((dir + "/cpu.max").c_str(), buf, sizeof(buf)) ||
+      lReadLine("/sys/fs/cgroup/cpu.max", buf, sizeof(buf))) {
+    if (sscanf(buf, "%lld %lld", &quota, &period) != 2) quota = -1;
+  } else if (lReadLine("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", buf,
+                       sizeof(buf))) {
+    quota = atoll(buf);
+    if (lReadLine("/sys/fs/cgroup/cpu/cpu.cfs_period_us", buf, sizeof(buf)))
+      period = atoll(buf);
+  }
+  if (quota <= 0 || period <= 0) return 0;
+  return int((quota + period - 1) / period);
+}
+
+static int lEnvInt(const char *name, int minValue) {
+  const char *value = getenv(name);
+  if (value == NULL || *value == '\0') return -1;
+  char *end;
+  long result = strtol(value, &end, 10);
+  if (*end != '\0' || result < minValue) {
+    fprintf(stderr, "Invalid value for %s: \"%s\"\n", name, value);
+    exit(1);
+  }
+  return int(result);
+}
+
+static Placement *lResolvePlacement(const TaskSysConfig &config) {
+  Placement *p = new Placement;
+
+  // CPUs we may run on
+  std::vector<int> allowed;
+#ifdef ISPC_IS_LINUX
+  cpu_set_t mask;
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &mask)) allowed.push_back(cpu);
+  }
+#endif
+  if (allowed.empty()) {
+    int numCpus = std::max(int(std::thread::hardware_concurrency()), 1);
+    for (int cpu = 0; cpu < numCpus; ++cpu) allowed.push_back(cpu);
+  }
+
+  std::string cpuList = config.cpus;
+  if (cpuList.empty() && getenv("ISPC_CPUS") != NULL)
+    cpuList = getenv("ISPC_CPUS");
+  if (!cpuList.empty()) {
+    std::vector<int> requested;
+    if (!lParseCpuList(cpuList.c_str(), &requested)) {
+      fprintf(stderr, "Invalid CPU list: \"%s\"\n", cpuList.c_str());
+      exit(1);
+    }
+    std::vector<int> usable;
+    for (int cpu : allowed)
+      if (std::find(requested.begin(), requested.end(), cpu) !=
+          requested.end())
+        usable.push_back(cpu);
+    if (usable.empty()) {
+      fprintf(stderr, "None of CPUs \"%s\" are available to this process\n",
+              cpuList.c_str());
+      exit(1);
+    }
+    allowed.swap(usable);
+  }
+
+  p->smt = config.smt >= 0 ? config.smt : lEnvInt("ISPC_SMT", 0);
+  bool smtSet = p->smt >= 0;
+  if (!smtSet) p->smt = 1;
+
+  // Order the CPUs by their rank on their physical core, so that threads
+  // spread across cores before doubling up on hardware threads
+  std::vector<int> cores, ranks;
+  for (int cpu : allowed) {
+    int core = lCoreOf(cpu);
+    int rank = int(std::count(cores.begin(), cores.end(), core));
+    cores.push_back(core);
+    ranks.push_back(rank);
+  }
+  for (int rank = 0; p->cpus.size() < allowed.size(); ++rank) {
+    if (rank > 0 && !p->smt) break;
+    for (size_t i = 0; i < allowed.size(); ++i)
+      if (ranks[i] == rank) p->cpus.push_back(allowed[i]);
+  }
+
+  p->numThreads = config.numThreads > 0 ? config.numThreads
+                                        : lEnvInt("ISPC_NUM_THREADS", 1);
+  if (p->numThreads <= 0) {
+    p->numThreads = int(p->cpus.size());
+    int limit = lCgroupCpuLimit();
+    if (limit > 0) p->numThreads = std::min(p->numThreads, limit);
+  }
+
+  p->maxLiveTasks = config.maxLiveTasks > 0
+                        ? config.maxLiveTasks
+                        : lEnvInt("ISPC_MAX_LIVE_TASKS", 1);
+  if (p->maxLiveTasks <= 0) p->maxLiveTasks = DEFAULT_MAX_LIVE_TASKS;
+
+  p->pin = !cpuList.empty() || (smtSet && !p->smt);
+  return p;
+}
+
+static const Placement &lGetPlacement() {
+  std::lock_guard<std::mutex> guard(placementMutex);
+  if (placement == NULL) placement = lResolvePlacement(requestedConfig);
+  return *placement;
+}
+
+/* CPU for worker threadIndex (1-based; the launching thread is 0 and keeps
+   the first CPU for itself).
+ */
+static int lWorkerCpu(int threadIndex) {
+  const Placement &p = lGetPlacement();
+  return p.cpus[threadIndex % p.cpus.size()];
+}
+
+static void lPinCurrentThread(int threadIndex) {
+#ifdef ISPC_IS_LINUX
+  if (!lGetPlacement().pin) return;
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(lWorkerCpu(threadIndex), &cpuset);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+#endif
+}
+
+bool ConfigureTaskSys(const TaskSysConfig &config) {
+  std::lock_guard<std::mutex> guard(placementMutex);
+  if (placement != NULL) return false;
+  requestedConfig = config;
+  return true;
+}
+
+TaskSysConfig GetTaskSysConfig() {
+  const Placement &p = lGetPlacement();
+  TaskSysConfig config;
+  config.numThreads = p.numThreads;
+  config.cpus = lFormatCpuList(p.cpus);
+  config.smt = p.smt;
+  config.maxLiveTasks = p.maxLiveTasks;
+  return config;
+}
+
+const char *GetTaskSysBackend() {
+#if defined(ISPC_USE_TASKRUNNER)
+  return "taskrunner";
+#elif defined(ISPC_USE_PTHREADS_FULLY_SUBSCRIBED)
+  return "pthreads-fully-subscribed";
+#elif defined(ISPC_USE_PTHREADS)
+  return "pthreads";
+#elif defined(ISPC_USE_CONCRT)
+  return "concrt";
+#elif defined(ISPC_USE_GCD)
+  return "gcd";
+#elif defined(ISPC_USE_TBB_PARALLEL_FOR)
+  return "tbb-parallel-for";
+#elif defined(ISPC_USE_TBB_TASK_GROUP)
+  return "tbb-task-group";
+#elif defined(ISPC_USE_OMP)
+  return "omp";
+#elif defined(ISPC_USE_HPX)
+  return "hpx";
+#else
+  return "unknown";
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Dispatch order
+
+static std::atomic<int> taskDispatch(-1);  // -1 until read from ISPC_DISPATCH
+
+void SetTaskDispatch(TaskDispatch dispatch) {
+  taskDispatch.store(int(dispatch), std::memory_order_relaxed);
+}
+
+TaskDispatch GetTaskDispatch() {
+  int dispatch = taskDispatch.load(std::memory_order_relaxed);
+  if (dispatch >= 0) return TaskDispatch(dispatch);
+
+  const char *value = getenv("ISPC_DISPATCH");
+  TaskDispatch fromEnv;
+  if (value == NULL || *value == '\0' || strcmp(value, "linear") == 0)
+    fromEnv = TaskDispatch::kLinear;
+  else if (strcmp(value, "morton") == 0)
+    fromEnv = TaskDispatch::kMorton;
+  else if (strcmp(value, "hilbert") == 0)
+    fromEnv = TaskDispatch::kHilbert;
+  else {
+    fprintf(stderr, "Invalid value for ISPC_DISPATCH: \"%s\"\n", value);
+    exit(1);
+  }
+  // Unless SetTaskDispatch() got there first
+  taskDispatch.compare_exchange_strong(dispatch, int(fromEnv),
+                                       std::memory_order_relaxed);
+  return TaskDispatch(taskDispatch.load(std::memory_order_relaxed));
+}
+
+static inline void lMortonDecode2(uint64_t d, int *x, int *y) {
+  *x = *y = 0;
+  for (int bit = 0; d != 0; ++bit, d >>= 2) {
+    *x |= int(d & 1) << bit;
+    *y |= int((d >> 1) & 1) << bit;
+  }
+}
+
+static inline void lMortonDecode3(uint64_t d, int *x, int *y, int *z) {
+  *x = *y = *z = 0;
+  for (int bit = 0; d != 0; ++bit, d >>= 3) {
+    *x |= int(d & 1) << bit;
+    *y |= int((d >> 1) & 1) << bit;
+    *z |= int((d >> 2) & 1) << bit;
+  }
+}
+
+// Position d along the Hilbert curve that fills a side x side square
+static inline void lHilbertDecode2(int side, uint64_t d, int *x, int *y) {
+  *x = *y = 0;
+  for (int s = 1; s < side; s *= 2, d /= 4) {
+    int rx = int(1 & (d / 2));
+    int ry = int(1 & (d ^ rx));
+    if (ry == 0) {
+      // Reflect the sub-square so that its curve joins up with the next one
+      if (rx == 1) {
+        *x = s - 1 - *x;
+        *y = s - 1 - *y;
+      }
+      std::swap(*x, *y);
+    }
+    *x += s * rx;
+    *y += s * ry;
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // TaskGroupBase
 
@@ -276,6 +651,7 @@ inline TaskGroupBase::~TaskGroupBase() {
   // Note: don't delete memBuffers[0], since it points to the start of
   // the "mem" member!
   for (int i = 1; i < NUM_MEM_BUFFERS; ++i) delete[](memBuffers[i]);
+  for (int i = 0; i < MAX_TASK_QUEUE_CHUNKS; ++i) delete[](taskInfo[i]);
 }
 
 inline void TaskGroupBase::Reset() {
@@ -305,8 +681,10 @@ inline TaskInfo *TaskGroupBase::GetTaskInfo(int index) {
     exit(1);
   }
 
-  if (taskInfo[chunk] == NULL)
+  if (taskInfo[chunk] == NULL) {
     taskInfo[chunk] = new TaskInfo[TASK_QUEUE_CHUNK_SIZE];
+    lCountHeapAllocation(TASK_QUEUE_CHUNK_SIZE * sizeof(TaskInfo));
+  }
   return &taskInfo[chunk][offset];
 }
 
@@ -327,9 +705,14 @@ inline void *TaskGroupBase::AllocMemory(int64_t size, int32_t alignment) {
 
   int allocSize = 1 << (12 + curMemBuffer);
   allocSize = std::max(int(size + alignment), allocSize);
-  char *newBuf = new char[allocSize];
-  memBufferSize[curMemBuffer] = allocSize;
-  memBuffers[curMemBuffer] = newBuf;
+  if (memBufferSize[curMemBuffer] < allocSize) {
+    // Buffers are kept when the group is Reset(), so that a recycled task
+    // group only allocates if it needs more memory than it ever has
+    delete[](memBuffers[curMemBuffer]);
+    memBuffers[curMemBuffer] = new char[allocSize];
+    memBufferSize[curMemBuffer] = allocSize;
+    lCountHeapAllocation(allocSize);
+  }
   return AllocMemory(size, alignment);
 }
 
@@ -373,6 +756,107 @@ static inline int32_t lAtomicAdd(volatile int32_t *v, int32_t delta) {
 #endif
 }
 
+///////////////////////////////////////////////////////////////////////////
+// SharedTaskRunner
+//
+// Always built so that C++ code can use the pool, ISPC launches only run on
+// it with ISPC_USE_TASKRUNNER.
+
+// Index of the current thread in the pool, 0 for threads outside of it
+static thread_local int lSharedThreadIndex = 0;
+
+SharedTaskRunner &SharedTaskRunner::Instance() {
+  // Never destroyed, since other threads may still be launching tasks
+  // while static objects are destroyed at exit
+  static SharedTaskRunner *instance =
+      new SharedTaskRunner(lGetPlacement().numThreads - 1);
+  return *instance;
+}
+
+SharedTaskRunner::SharedTaskRunner(int numWorkers) {
+  for (int i = 0; i < numWorkers; ++i)
+    workers.emplace_back(&SharedTaskRunner::WorkerLoop, this, i + 1);
+}
+
+void SharedTaskRunner::Launch(Group *group, TaskFunction fn, void *data,
+                              int count) {
+  if (count <= 0) return;
+  group->numUnfinished.fetch_add(count, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    PushLocked(QueuedLaunch{group, fn, data, count, 0});
+  }
+  // A single wake-up call for the whole launch
+  if (count > 1)
+    workCond.notify_all();
+  else
+    workCond.notify_one();
+}
+
+void SharedTaskRunner::Wait(Group *group) {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (group->numUnfinished.load(std::memory_order_acquire) > 0) {
+    if (RunChunkLocked(lock, lSharedThreadIndex)) continue;
+    // The rest of the group's tasks are running on other threads
+    doneCond.wait(lock, [group] {
+      return group->numUnfinished.load(std::memory_order_acquire) == 0;
+    });
+  }
+}
+
+void SharedTaskRunner::PushLocked(const QueuedLaunch &launch) {
+  if (queueSize == queue.size()) {
+    // Unroll the ring into a buffer twice the size
+    std::vector<QueuedLaunch> grown(std::max(queue.size() * 2, size_t(16)));
+    for (size_t i = 0; i < queueSize; ++i)
+      grown[i] = queue[(queueHead + i) % queue.size()];
+    lCountHeapAllocation(grown.size() * sizeof(QueuedLaunch));
+    queue.swap(grown);
+    queueHead = 0;
+  }
+  queue[(queueHead + queueSize) % queue.size()] = launch;
+  ++queueSize;
+}
+
+void SharedTaskRunner::WorkerLoop(int threadIndex) {
+  lSharedThreadIndex = threadIndex;
+  lPinCurrentThread(threadIndex);
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (1) {
+    if (!RunChunkLocked(lock, threadIndex)) workCond.wait(lock);
+  }
+}
+
+bool SharedTaskRunner::RunChunkLocked(std::unique_lock<std::mutex> &lock,
+                                      int threadIndex) {
+  if (queueSize == 0) return false;
+
+  // Claim a share of the remaining tasks that shrinks as the launch
+  // progresses, so that we take the lock far less often than once per
+  // task but still balance the tail
+  QueuedLaunch &front = queue[queueHead];
+  int chunk = std::max(1, (front.count - front.next) / (2 * NumThreads()));
+  int begin = front.next;
+  int end = begin + chunk;
+  front.next = end;
+  QueuedLaunch launch = front;
+  if (end == launch.count) {
+    queueHead = (queueHead + 1) % queue.size();
+    --queueSize;
+  }
+  lock.unlock();
+
+  for (int i = begin; i < end; ++i)
+    launch.fn(launch.data, threadIndex, NumThreads(), i, launch.count);
+
+  // The group may be destroyed as soon as its count reaches zero
+  bool done = launch.group->numUnfinished.fetch_sub(
+                  chunk, std::memory_order_acq_rel) == chunk;
+  lock.lock();
+  if (done) doneCond.notify_all();
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
 #ifdef ISPC_USE_CONCRT
@@ -402,37 +886,63 @@ class TaskGroup : public TaskGroupBase {
 #endif  // ISPC_USE_GCD
 
 #ifdef ISPC_USE_PTHREADS
-static void *lTaskEntry(void *arg);
+/* Task groups with waiting tasks are published in a fixed table of slots
+   (see lActivateTaskGroup()), so workers find work without a global lock.
+ */
+#define MAX_ACTIVE_TASK_GROUPS 64
 
 class TaskGroup : public TaskGroupBase {
  public:
   TaskGroup() {
     numUnfinishedTasks = 0;
-    waitingTasks.reserve(128);
-    inActiveList = false;
+    nextTask = 0;
+    numLaunchedTasks = 0;
+    activeSlot = -1;
   }
 
   void Reset() {
     TaskGroupBase::Reset();
     numUnfinishedTasks = 0;
-    assert(inActiveList == false);
+    nextTask = 0;
+    numLaunchedTasks = 0;
+    assert(activeSlot == -1);
     lMemFence();
   }
 
   void Launch(int baseIndex, int count);
   void Sync();
 
- private:
-  friend void *lTaskEntry(void *arg);
+  /* Claim the next task launched in this group that no thread has
+     started yet, returning false if there is none.
+   */
+  bool ClaimTask(int *taskNumber);
+  void RunTask(int taskNumber, int threadIndex, int threadCount);
 
+ private:
   int32_t numUnfinishedTasks;
   int32_t pad[3];
-  std::vector<int> waitingTasks;
-  bool inActiveList;
+  // Tasks [0, nextTask) have been claimed and tasks [0, numLaunchedTasks)
+  // have had their TaskInfo filled in. Only the thread that owns the group
+  // advances numLaunchedTasks, other threads only advance nextTask.
+  volatile int32_t nextTask;
+  volatile int32_t numLaunchedTasks;
+  int activeSlot;  // Index in the active slot table, -1 if not published
 };
 
 #endif  // ISPC_USE_PTHREADS
 
+#ifdef ISPC_USE_TASKRUNNER
+// Launches are queued on the shared pool, which tracks their completion
+class TaskGroup : public TaskGroupBase {
+ public:
+  void Launch(int baseIndex, int count);
+  void Sync();
+
+ private:
+  SharedTaskRunner::Group group;
+};
+#endif  // ISPC_USE_TASKRUNNER
+
 #ifdef ISPC_USE_OMP
 
 class TaskGroup : public TaskGroupBase {
@@ -588,82 +1098,122 @@ static volatile int32_t lock = 0;
 static int nThreads;
 static pthread_t *threads = NULL;
 
-static pthread_mutex_t taskSysMutex;
-static std::vector<TaskGroup *> activeTaskGroups;
-static sem_t *workerSemaphore;
+/* A task group's slot holds it from its first launch until its Sync()
+   completes. Workers scanning the table count themselves in the slot's
+   "refs" before reading the group pointer, and Sync() clears the pointer
+   and then waits for refs to drop to zero, so a worker never touches a
+   group after it has been recycled. (Once a worker has claimed a task the
+   group can't finish syncing until that task completes.)
+ */
+struct ActiveSlot {
+  TaskGroup *volatile group;
+  volatile int32_t refs;
+  int32_t pad[13];  // Keep each slot in its own cache line
+};
+static ActiveSlot activeSlots[MAX_ACTIVE_TASK_GROUPS];
+
+/* Idle workers sleep on workerCond until wakeGeneration changes. Launches
+   bump the generation and only take the mutex to broadcast if some worker
+   is asleep, so a launch wakes all of the workers with a single call no
+   matter how many tasks it has.
+ */
+static pthread_mutex_t workerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workerCond = PTHREAD_COND_INITIALIZER;
+static volatile int32_t wakeGeneration = 0;
+static volatile int32_t numSleepingWorkers = 0;
+
+static int lActivateTaskGroup(TaskGroup *tg) {
+  for (int i = 0; i < MAX_ACTIVE_TASK_GROUPS; ++i) {
+    if (activeSlots[i].group == NULL &&
+        lAtomicCompareAndSwapPointer((void **)&activeSlots[i].group, tg,
+                                     NULL) == NULL)
+      return i;
+  }
+  // Every slot is taken, so only the thread that syncs this group will run
+  // its tasks
+  return -1;
+}
+
+static void lDeactivateTaskGroup(int slot) {
+  activeSlots[slot].group = NULL;
+  lMemFence();
+  while (activeSlots[slot].refs > 0) sched_yield();
+}
+
+/* Run one task from any published task group, starting the search at slot
+   "first" so that workers spread out across the groups.
+ */
+static bool lRunActiveTask(int first, int threadIndex, int threadCount) {
+  for (int k = 0; k < MAX_ACTIVE_TASK_GROUPS; ++k) {
+    ActiveSlot &slot = activeSlots[(first + k) % MAX_ACTIVE_TASK_GROUPS];
+    if (slot.group == NULL) continue;
+
+    lAtomicAdd(&slot.refs, 1);
+    TaskGroup *tg = slot.group;
+    int taskNumber;
+    bool claimed = tg != NULL && tg->ClaimTask(&taskNumber);
+    lAtomicAdd(&slot.refs, -1);
+
+    if (claimed) {
+      tg->RunTask(taskNumber, threadIndex, threadCount);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void lWakeWorkers() {
+  lAtomicAdd(&wakeGeneration, 1);
+  if (numSleepingWorkers == 0) return;
+
+  int err;
+  if ((err = pthread_mutex_lock(&workerMutex)) != 0) {
+    fprintf(stderr, "Error from pthread_mutex_lock: %s\n", strerror(err));
+    exit(1);
+  }
+  if ((err = pthread_cond_broadcast(&workerCond)) != 0) {
+    fprintf(stderr, "Error from pthread_cond_broadcast: %s\n", strerror(err));
+    exit(1);
+  }
+  if ((err = pthread_mutex_unlock(&workerMutex)) != 0) {
+    fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
+    exit(1);
+  }
+}
 
 static void *lTaskEntry(void *arg) {
   int threadIndex = (int)((int64_t)arg);
   int threadCount = nThreads;
+  lPinCurrentThread(threadIndex + 1);
 
   while (1) {
-    int err;
-    //
-    // Wait on the semaphore until we're woken up due to the arrival of
-    // more work.
-    //
-    if ((err = sem_wait(workerSemaphore)) != 0) {
-      fprintf(stderr, "Error from sem_wait: %s\n", strerror(err));
-      exit(1);
-    }
+    // Read the generation before looking for work, so that a launch that
+    // we miss while searching still wakes us up below
+    int32_t generation = wakeGeneration;
+    lMemFence();
+
+    if (lRunActiveTask(threadIndex, threadIndex, threadCount)) continue;
 
     //
-    // Acquire the mutex
+    // No work anywhere, sleep until the next launch
     //
-    if ((err = pthread_mutex_lock(&taskSysMutex)) != 0) {
+    int err;
+    if ((err = pthread_mutex_lock(&workerMutex)) != 0) {
       fprintf(stderr, "Error from pthread_mutex_lock: %s\n", strerror(err));
       exit(1);
     }
-
-    if (activeTaskGroups.size() == 0) {
-      //
-      // Task queue is empty, go back and wait on the semaphore
-      //
-      if ((err = pthread_mutex_unlock(&taskSysMutex)) != 0) {
-        fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
+    lAtomicAdd(&numSleepingWorkers, 1);
+    while (wakeGeneration == generation) {
+      if ((err = pthread_cond_wait(&workerCond, &workerMutex)) != 0) {
+        fprintf(stderr, "Error from pthread_cond_wait: %s\n", strerror(err));
         exit(1);
       }
-      continue;
     }
-
-    //
-    // Get the last task group on the active list and the last task
-    // from its waiting tasks list.
-    //
-    TaskGroup *tg = activeTaskGroups.back();
-    assert(tg->waitingTasks.size() > 0);
-    int taskNumber = tg->waitingTasks.back();
-    tg->waitingTasks.pop_back();
-
-    if (tg->waitingTasks.size() == 0) {
-      // We just took the last task from this task group, so remove
-      // it from the active list.
-      activeTaskGroups.pop_back();
-      tg->inActiveList = false;
-    }
-
-    if ((err = pthread_mutex_unlock(&taskSysMutex)) != 0) {
+    lAtomicAdd(&numSleepingWorkers, -1);
+    if ((err = pthread_mutex_unlock(&workerMutex)) != 0) {
       fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
       exit(1);
     }
-
-    //
-    // And now actually run the task
-    //
-    DBG(fprintf(stderr, "running task %d from group %p\n", taskNumber, tg));
-    TaskInfo *myTask = tg->GetTaskInfo(taskNumber);
-    myTask->func(myTask->data, threadIndex, threadCount, myTask->taskIndex,
-                 myTask->taskCount(), myTask->taskIndex0(),
-                 myTask->taskIndex1(), myTask->taskIndex2(),
-                 myTask->taskCount0(), myTask->taskCount1(),
-                 myTask->taskCount2());
-
-    //
-    // Decrement the "number of unfinished tasks" counter in the task
-    // group.
-    //
-    lMemFence();
-    lAtomicAdd(&tg->numUnfinishedTasks, -1);
   }
 
   pthread_exit(NULL);
@@ -675,40 +1225,16 @@ static void InitTaskSystem() {
     while (1) {
       if (lAtomicCompareAndSwap32(&lock, 1, 0) == 0) {
         if (threads == NULL) {
-          // We launch one fewer thread than there are cores,
+          // We launch one fewer thread than the placement allows,
           // since the main thread here will also grab jobs from
           // the task queue itself.
-          nThreads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
-
-          int err;
-          if ((err = pthread_mutex_init(&taskSysMutex, NULL)) != 0) {
-            fprintf(stderr, "Error creating mutex: %s\n", strerror(err));
-            exit(1);
-          }
-
-          char name[32];
-          bool success = false;
-          srand(time(NULL));
-          for (int i = 0; i < 10; i++) {
-            sprintf(name, "ispc_task.%d.%d", (int)getpid(), (int)rand());
-            workerSemaphore = sem_open(name, O_CREAT, S_IRUSR | S_IWUSR, 0);
-            if (workerSemaphore != SEM_FAILED) {
-              success = true;
-              break;
-            }
-            fprintf(stderr, "Failed to create %s\n", name);
-          }
-
-          if (!success) {
-            fprintf(stderr, "Error creating semaphore (%s): %s\n", name,
-                    strerror(errno));
-            exit(1);
-          }
+          nThreads = lGetPlacement().numThreads - 1;
 
-          threads = (pthread_t *)malloc(nThreads * sizeof(pthread_t));
+          pthread_t *newThreads =
+              (pthread_t *)malloc(std::max(nThreads, 1) * sizeof(pthread_t));
           for (int i = 0; i < nThreads; ++i) {
-            err = pthread_create(&threads[i], NULL, &lTaskEntry,
-                                 (void *)((long long)i));
+            int err = pthread_create(&newThreads[i], NULL, &lTaskEntry,
+                                     (void *)((long long)i));
             if (err != 0) {
               fprintf(stderr, "Error creating pthread %d: %s\n", i,
                       strerror(err));
@@ -716,11 +1242,12 @@ static void InitTaskSystem() {
             }
           }
 
-          activeTaskGroups.reserve(64);
+          // Make sure all of the above goes to memory before other
+          // threads can see that the task system is initialized.
+          lMemFence();
+          threads = newThreads;
         }
 
-        // Make sure all of the above goes to memory before we
-        // clear the lock.
         lMemFence();
         lock = 0;
         break;
@@ -729,152 +1256,113 @@ static void InitTaskSystem() {
   }
 }
 
-inline void TaskGroup::Launch(int baseCoord, int count) {
-  //
-  // Acquire mutex, add task
-  //
-  int err;
-  if ((err = pthread_mutex_lock(&taskSysMutex)) != 0) {
-    fprintf(stderr, "Error from pthread_mutex_lock: %s\n", strerror(err));
-    exit(1);
-  }
-
-  // Add the corresponding set of tasks to the waiting-to-be-run list for
-  // this task group.
-  //
-  // FIXME: it's a little ugly to hold a global mutex for this when we
-  // only need to make sure no one else is accessing this task group's
-  // waitingTasks list.  (But a small experiment in switching to a
-  // per-TaskGroup mutex showed worse performance!)
-  for (int i = 0; i < count; ++i) waitingTasks.push_back(baseCoord + i);
-
-  // Add the task group to the global active list if it isn't there
-  // already.
-  if (inActiveList == false) {
-    activeTaskGroups.push_back(this);
-    inActiveList = true;
+inline bool TaskGroup::ClaimTask(int *taskNumber) {
+  while (1) {
+    int32_t next = nextTask;
+    if (next >= numLaunchedTasks) return false;
+    if (lAtomicCompareAndSwap32(&nextTask, next + 1, next) == next) {
+      *taskNumber = next;
+      return true;
+    }
   }
+}
 
-  if ((err = pthread_mutex_unlock(&taskSysMutex)) != 0) {
-    fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
-    exit(1);
-  }
+inline void TaskGroup::RunTask(int taskNumber, int threadIndex,
+                               int threadCount) {
+  DBG(fprintf(stderr, "running task %d from group %p\n", taskNumber, this));
+  TaskInfo *myTask = GetTaskInfo(taskNumber);
+  myTask->func(myTask->data, threadIndex, threadCount, myTask->taskIndex,
+               myTask->taskCount(), myTask->taskIndex0(), myTask->taskIndex1(),
+               myTask->taskIndex2(), myTask->taskCount0(),
+               myTask->taskCount1(), myTask->taskCount2());
 
   //
-  // Update the count of the number of tasks left to run in this task
-  // group.
+  // Decrement the "number of unfinished tasks" counter in the task group.
+  // The group may be synced and recycled as soon as this reaches zero, so
+  // this must be the last access to it.
   //
   lMemFence();
+  lAtomicAdd(&numUnfinishedTasks, -1);
+}
+
+inline void TaskGroup::Launch(int baseIndex, int count) {
+  // Launches within a group are contiguous, so publishing the new tasks is
+  // just a matter of advancing numLaunchedTasks once their TaskInfo (and the
+  // unfinished count that Sync() waits on) are in memory.
+  assert(baseIndex == numLaunchedTasks);
   lAtomicAdd(&numUnfinishedTasks, count);
+  lMemFence();
+  numLaunchedTasks = baseIndex + count;
 
-  //
-  // Post to the worker semaphore to wake up worker threads that are
-  // sleeping waiting for tasks to show up
-  //
-  for (int i = 0; i < count; ++i)
-    if ((err = sem_post(workerSemaphore)) != 0) {
-      fprintf(stderr, "Error from sem_post: %s\n", strerror(err));
-      exit(1);
-    }
+  if (activeSlot < 0) activeSlot = lActivateTaskGroup(this);
+  lWakeWorkers();
 }
 
 inline void TaskGroup::Sync() {
-  DBG(fprintf(stderr, "syncing %p - %d unfinished\n", tg, numUnfinishedTasks));
+  DBG(fprintf(stderr, "syncing %p - %d unfinished\n", this,
+              numUnfinishedTasks));
 
   while (numUnfinishedTasks > 0) {
-    // All of the tasks in this group aren't finished yet.  We'll try
-    // to help out here since we don't have anything else to do...
-
-    DBG(fprintf(stderr, "while syncing %p - %d unfinished\n", tg,
-                numUnfinishedTasks));
-
+    // All of the tasks in this group aren't finished yet.  We'll try to
+    // help out here since we don't have anything else to do, first with
+    // our own tasks and then with any other group's.
     //
-    // Acquire the global task system mutex to grab a task to work on
-    //
-    int err;
-    if ((err = pthread_mutex_lock(&taskSysMutex)) != 0) {
-      fprintf(stderr, "Error from pthread_mutex_lock: %s\n", strerror(err));
-      exit(1);
+    // FIXME: bogus values for thread index/thread count here as well..
+    int taskNumber;
+    if (ClaimTask(&taskNumber)) {
+      RunTask(taskNumber, 0, 1);
+    } else if (!lRunActiveTask(0, 0, 1)) {
+      // Other threads are running the rest of our tasks
+      usleep(1);
     }
+  }
 
-    TaskInfo *myTask = NULL;
-    TaskGroup *runtg = this;
-    if (waitingTasks.size() > 0) {
-      int taskNumber = waitingTasks.back();
-      waitingTasks.pop_back();
-
-      if (waitingTasks.size() == 0) {
-        // There's nothing left to start running from this group,
-        // so remove it from the active task list.
-        activeTaskGroups.erase(
-            std::find(activeTaskGroups.begin(), activeTaskGroups.end(), this));
-        inActiveList = false;
-      }
-      myTask = GetTaskInfo(taskNumber);
-      DBG(fprintf(stderr, "running task %d from group %p in sync\n", taskNumber,
-                  tg));
-    } else {
-      // Other threads are already working on all of the tasks in
-      // this group, so we can't help out by running one ourself.
-      // We'll try to run one from another group to make ourselves
-      // useful here.
-      if (activeTaskGroups.size() == 0) {
-        // No active task groups left--there's nothing for us to do.
-        if ((err = pthread_mutex_unlock(&taskSysMutex)) != 0) {
-          fprintf(stderr, "Error from pthread_mutex_unlock: %s\n",
-                  strerror(err));
-          exit(1);
-        }
-        // FIXME: We basically end up busy-waiting here, which is
-        // extra wasteful in a world with hyper-threading.  It would
-        // be much better to put this thread to sleep on a
-        // condition variable that was signaled when the last task
-        // in this group was finished.
-        usleep(1);
-        continue;
-      }
+  if (activeSlot >= 0) {
+    lDeactivateTaskGroup(activeSlot);
+    activeSlot = -1;
+  }
+  DBG(fprintf(stderr, "sync for %p done!n", this));
+}
 
-      // Get a task to run from another task group.
-      runtg = activeTaskGroups.back();
-      assert(runtg->waitingTasks.size() > 0);
-
-      int taskNumber = runtg->waitingTasks.back();
-      runtg->waitingTasks.pop_back();
-      if (runtg->waitingTasks.size() == 0) {
-        // There's left to start running from this group, so remove
-        // it from the active task list.
-        activeTaskGroups.pop_back();
-        runtg->inActiveList = false;
-      }
-      myTask = runtg->GetTaskInfo(taskNumber);
-      DBG(fprintf(stderr, "running task %d from other group %p in sync\n",
-                  taskNumber, runtg));
-    }
+#endif  // ISPC_USE_PTHREADS
 
-    if ((err = pthread_mutex_unlock(&taskSysMutex)) != 0) {
-      fprintf(stderr, "Error from pthread_mutex_unlock: %s\n", strerror(err));
-      exit(1);
-    }
+///////////////////////////////////////////////////////////////////////////
+// SharedTaskRunner
 
-    //
-    // Do work for _myTask_
-    //
-    // FIXME: bogus values for thread index/thread count here as well..
-    myTask->func(myTask->data, 0, 1, myTask->taskIndex, myTask->taskCount(),
-                 myTask->taskIndex0(), myTask->taskIndex1(),
-                 myTask->taskIndex2(), myTask->taskCount0(),
-                 myTask->taskCount1(), myTask->taskCount2());
+#ifdef ISPC_USE_TASKRUNNER
 
-    //
-    // Decrement the number of unfinished tasks counter
-    //
-    lMemFence();
-    lAtomicAdd(&runtg->numUnfinishedTasks, -1);
-  }
-  DBG(fprintf(stderr, "sync for %p done!n", tg));
+static void InitTaskSystem() {
+  // The pool is created on first use
 }
 
-#endif  // ISPC_USE_PTHREADS
+// Locates the TaskInfo of a launch's tasks within its task group
+struct TaskRunnerLaunch {
+  TaskGroup *taskGroup;
+  int baseIndex;
+};
+
+static void lRunTaskRunnerTask(void *data, int threadIndex, int threadCount,
+                               int taskIndex, int taskCount) {
+  TaskRunnerLaunch *launch = (TaskRunnerLaunch *)data;
+  TaskInfo *ti = launch->taskGroup->GetTaskInfo(launch->baseIndex + taskIndex);
+  ti->func(ti->data, threadIndex, threadCount, ti->taskIndex, ti->taskCount(),
+           ti->taskIndex0(), ti->taskIndex1(), ti->taskIndex2(),
+           ti->taskCount0(), ti->taskCount1(), ti->taskCount2());
+}
+
+inline void TaskGroup::Launch(int baseIndex, int count) {
+  // Lives in the group's memory until the group is reset after syncing
+  TaskRunnerLaunch *launch = (TaskRunnerLaunch *)AllocMemory(
+      sizeof(TaskRunnerLaunch), alignof(TaskRunnerLaunch));
+  launch->taskGroup = this;
+  launch->baseIndex = baseIndex;
+  SharedTaskRunner::Instance().Launch(&group, &lRunTaskRunnerTask, launch,
+                                      count);
+}
+
+inline void TaskGroup::Sync() { SharedTaskRunner::Instance().Wait(&group); }
+
+#endif  // ISPC_USE_TASKRUNNER
 
 ///////////////////////////////////////////////////////////////////////////
 // OpenMP
@@ -995,7 +1483,29 @@ inline void TaskGroup::Sync() {
 #define MAX_FREE_TASK_GROUPS 64
 static TaskGroup *freeTaskGroups[MAX_FREE_TASK_GROUPS];
 
+static inline void FreeSharedTaskGroup(TaskGroup *tg);
+
+/* Each thread keeps the last few task groups it freed, so that a thread
+   that repeatedly calls a launching ispc function reuses the same groups
+   (and the memory they have already allocated) without touching the
+   shared freeTaskGroups[] array.  Groups still cached when the thread
+   exits are handed back to the shared array.
+ */
+#define MAX_THREAD_TASK_GROUPS 4
+struct ThreadTaskGroups {
+  int count;
+  TaskGroup *groups[MAX_THREAD_TASK_GROUPS];
+
+  ~ThreadTaskGroups() {
+    while (count > 0) FreeSharedTaskGroup(groups[--count]);
+  }
+};
+static thread_local ThreadTaskGroups threadTaskGroups;
+
 static inline TaskGroup *AllocTaskGroup() {
+  if (threadTaskGroups.count > 0)
+    return threadTaskGroups.groups[--threadTaskGroups.count];
+
   for (int i = 0; i < MAX_FREE_TASK_GROUPS; ++i) {
     TaskGroup *tg = freeTaskGroups[i];
     if (tg != NULL) {
@@ -1007,12 +1517,11 @@ static inline TaskGroup *AllocTaskGroup() {
     }
   }
 
+  lCountHeapAllocation(sizeof(TaskGroup));
   return new TaskGroup;
 }
 
-static inline void FreeTaskGroup(TaskGroup *tg) {
-  tg->Reset();
-
+static inline void FreeSharedTaskGroup(TaskGroup *tg) {
   for (int i = 0; i < MAX_FREE_TASK_GROUPS; ++i) {
     if (freeTaskGroups[i] == NULL) {
       void *ptr =
@@ -1024,11 +1533,69 @@ static inline void FreeTaskGroup(TaskGroup *tg) {
   delete tg;
 }
 
+static inline void FreeTaskGroup(TaskGroup *tg) {
+  tg->Reset();
+
+  if (threadTaskGroups.count < MAX_THREAD_TASK_GROUPS) {
+    threadTaskGroups.groups[threadTaskGroups.count++] = tg;
+    return;
+  }
+  FreeSharedTaskGroup(tg);
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
+/* Reassign the taskIndex of the count0 x count1 x count2 tasks that were
+   just allocated at baseIndex so that they are handed out along the
+   dispatch curve.  The curve fills the enclosing power-of-two square (or
+   cube); both curves visit each aligned power-of-two block of it in one
+   contiguous stretch, so whole blocks that fall outside the grid are
+   skipped at once.
+ */
+static void lOrderTasks(TaskGroupBase *tg, int baseIndex, int count0,
+                        int count1, int count2, TaskDispatch dispatch) {
+  const bool is3d = count2 > 1;
+  const int dims = is3d ? 3 : 2;
+  int side = 1;
+  while (side < std::max(count0, std::max(count1, count2))) side *= 2;
+  const uint64_t numCells = uint64_t(1) << (dims * __builtin_ctz(side));
+
+  int next = baseIndex;
+  for (uint64_t d = 0; d < numCells;) {
+    int x, y, z = 0;
+    if (is3d)
+      lMortonDecode3(d, &x, &y, &z);
+    else if (dispatch == TaskDispatch::kHilbert)
+      lHilbertDecode2(side, d, &x, &y);
+    else
+      lMortonDecode2(d, &x, &y);
+
+    if (x < count0 && y < count1 && z < count2) {
+      tg->GetTaskInfo(next++)->taskIndex = x + count0 * (y + count1 * z);
+      ++d;
+      continue;
+    }
+
+    // Grow the skipped block while the next larger one starts at d and
+    // still lies entirely outside the grid
+    int s = 1;
+    while (2 * s <= side) {
+      int mask = ~(2 * s - 1);
+      uint64_t cells = uint64_t(1) << (dims * __builtin_ctz(2 * s));
+      if (d % cells != 0 ||
+          ((x & mask) < count0 && (y & mask) < count1 && (z & mask) < count2))
+        break;
+      s *= 2;
+    }
+    d += uint64_t(1) << (dims * __builtin_ctz(s));
+  }
+  assert(next == baseIndex + count0 * count1 * count2);
+}
+
 void ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count0,
                 int count1, int count2) {
   const int count = count0 * count1 * count2;
+  lCountLaunch();
   TaskGroup *taskGroup;
   if (*taskGroupPtr == NULL) {
     InitTaskSystem();
@@ -1047,6 +1614,11 @@ void ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count0,
     ti->taskCount3d[1] = count1;
     ti->taskCount3d[2] = count2;
   }
+  if (count1 > 1 || count2 > 1) {
+    TaskDispatch dispatch = GetTaskDispatch();
+    if (dispatch != TaskDispatch::kLinear)
+      lOrderTasks(taskGroup, baseIndex, count0, count1, count2, dispatch);
+  }
   taskGroup->Launch(baseIndex, count);
 }
 
@@ -1072,8 +1644,6 @@ void *ISPCAlloc(void **taskGroupPtr, int64_t size, int32_t alignment) {
 
 #else  // ISPC_USE_PTHREADS_FULLY_SUBSCRIBED
 
-#define MAX_LIVE_TASKS 1024
-
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
 // Small structure used to hold the data for each task
@@ -1083,6 +1653,13 @@ struct Task {
   void *data;
   volatile int32_t taskIndex;
   int taskCount;
+  int taskCount3d[3];
+
+  /* Argument memory returned by ISPCAlloc().  It is kept when the task is
+     recycled and only reallocated when a launch needs more than it holds.
+   */
+  char *argMem;
+  int64_t argCapacity;
 
   volatile int numDone;
   int liveIndex;  // index in live task queue
@@ -1136,31 +1713,40 @@ class TaskSys {
   // return old; } inline int inc_end() { int old = end; end =
   // (end+1)%MAX_TASKS; return old; }
 
-  LiveTask taskQueue[MAX_LIVE_TASKS];
-  std::stack<Task *> taskMem;
+  int maxLiveTasks;  // From the placement (ISPC_MAX_LIVE_TASKS)
+  LiveTask *taskQueue;
+  Task **taskMem;  // Free tasks
+  int numTaskMem;
 
   static TaskSys *global;
 
   TaskSys() : nextScheduleIndex(0) {
     TaskSys::global = this;
+    maxLiveTasks = lGetPlacement().maxLiveTasks;
+    taskQueue = new LiveTask[maxLiveTasks];
+    taskMem = new Task *[maxLiveTasks];
     Task *mem =
-        new Task[MAX_LIVE_TASKS];  //< could actually be more than _live_ tasks
-    for (int i = 0; i < MAX_LIVE_TASKS; i++) {
-      taskMem.push(mem + i);
+        new Task[maxLiveTasks];  //< could actually be more than _live_ tasks
+    lCountHeapAllocation(maxLiveTasks * (sizeof(LiveTask) + sizeof(Task *) +
+                                         sizeof(Task)));
+    for (int i = 0; i < maxLiveTasks; i++) {
+      mem[i].argMem = NULL;
+      mem[i].argCapacity = 0;
+      taskMem[i] = mem + i;
     }
+    numTaskMem = maxLiveTasks;
     createThreads();
   }
 
   inline Task *allocOne() {
     pthread_mutex_lock(&mutex);
-    if (taskMem.empty()) {
+    if (numTaskMem == 0) {
       fprintf(stderr,
               "Too many live tasks.  "
-              "Change the value of MAX_LIVE_TASKS and recompile.\n");
+              "Increase ISPC_MAX_LIVE_TASKS.\n");
       exit(1);
     }
-    Task *task = taskMem.top();
-    taskMem.pop();
+    Task *task = taskMem[--numTaskMem];
     pthread_mutex_unlock(&mutex);
     return task;
   }
@@ -1181,11 +1767,11 @@ class TaskSys {
   inline void schedule(Task *t) {
     pthread_mutex_lock(&mutex);
     int liveIndex = nextScheduleIndex;
-    nextScheduleIndex = (nextScheduleIndex + 1) % MAX_LIVE_TASKS;
+    nextScheduleIndex = (nextScheduleIndex + 1) % maxLiveTasks;
     if (taskQueue[liveIndex].active) {
       fprintf(stderr,
               "Out of task queue resources.  "
-              "Change the value of MAX_LIVE_TASKS and recompile.\n");
+              "Increase ISPC_MAX_LIVE_TASKS.\n");
       exit(1);
     }
     taskQueue[liveIndex].task = t;
@@ -1202,9 +1788,8 @@ class TaskSys {
     while (taskQueue[liveIndex].locks > 1) {
       usleep(1);
     }
-    _mm_free(task->data);
     pthread_mutex_lock(&mutex);
-    taskMem.push(task);  // recycle task index
+    taskMem[numTaskMem++] = task;  // recycle task index
     taskQueue[liveIndex].active = false;
     pthread_mutex_unlock(&mutex);
   }
@@ -1225,12 +1810,17 @@ void TaskSys::threadFct() {
       mine->run(job, myIndex);
     }
     taskQueue[myIndex].doneWithThis();
-    myIndex = (myIndex + 1) % MAX_LIVE_TASKS;
+    myIndex = (myIndex + 1) % maxLiveTasks;
   }
 }
 
 inline void Task::run(int idx, int threadIdx) {
-  (*this->func)(data, threadIdx, TaskSys::global->nThreads, idx, taskCount);
+  int taskIndex0 = idx % taskCount3d[0];
+  int taskIndex1 = (idx / taskCount3d[0]) % taskCount3d[1];
+  int taskIndex2 = idx / (taskCount3d[0] * taskCount3d[1]);
+  (*this->func)(data, threadIdx, TaskSys::global->nThreads, idx, taskCount,
+                taskIndex0, taskIndex1, taskIndex2, taskCount3d[0],
+                taskCount3d[1], taskCount3d[2]);
   markOneDone();
 }
 
@@ -1241,11 +1831,11 @@ void *_threadFct(void *data) {
 
 void TaskSys::createThreads() {
   init();
-  int reserved = 4;
-  int minid = 2;
-  nThreads = sysconf(_SC_NPROCESSORS_ONLN) - reserved;
+  // One worker per placement thread besides the creator, always pinned
+  // since this model takes over the CPUs it runs on
+  nThreads = lGetPlacement().numThreads - 1;
 
-  thread = (pthread_t *)malloc(nThreads * sizeof(pthread_t));
+  thread = (pthread_t *)malloc(std::max(nThreads, 1) * sizeof(pthread_t));
 
   numThreadsRunning = 0;
   for (int i = 0; i < nThreads; ++i) {
@@ -1253,11 +1843,10 @@ void TaskSys::createThreads() {
     pthread_attr_init(&attr);
     pthread_attr_setstacksize(&attr, 2 * 1024 * 1024);
 
-    int threadID = minid + i;
     cpu_set_t cpuset;
     CPU_ZERO(&cpuset);
-    CPU_SET(threadID, &cpuset);
-    int ret = pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+    CPU_SET(lWorkerCpu(i + 1), &cpuset);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
 
     int err = pthread_create(&thread[i], &attr, &_threadFct, this);
     ++numThreadsRunning;
@@ -1273,12 +1862,17 @@ int TaskSys::numThreadsRunning = 0;
 
 ///////////////////////////////////////////////////////////////////////////
 
-void ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count) {
+void ISPCLaunch(void **taskGroupPtr, void *func, void *data, int count0,
+                int count1, int count2) {
+  lCountLaunch();
   Task *ti = *(Task **)taskGroupPtr;
   ti->func = (TaskFuncType)func;
   ti->data = data;
   ti->taskIndex = 0;
-  ti->taskCount = count;
+  ti->taskCount = count0 * count1 * count2;
+  ti->taskCount3d[0] = count0;
+  ti->taskCount3d[1] = count1;
+  ti->taskCount3d[2] = count2;
   TaskSys::global->schedule(ti);
 }
 
@@ -1292,7 +1886,15 @@ void *ISPCAlloc(void **taskGroupPtr, int64_t size, int32_t alignment) {
   TaskSys::init();
   Task *task = TaskSys::global->allocOne();
   *taskGroupPtr = task;
-  task->data = _mm_malloc(size, alignment);
+  if (task->argCapacity < size + alignment) {
+    delete[] task->argMem;
+    task->argCapacity = std::max(size + alignment, int64_t(256));
+    task->argMem = new char[task->argCapacity];
+    lCountHeapAllocation(task->argCapacity);
+  }
+  intptr_t iptr = (intptr_t)task->argMem;
+  iptr = (iptr + (alignment - 1)) & ~(intptr_t)(alignment - 1);
+  task->data = (void *)iptr;
   return task->data;  //*taskGroupPtr;
 }
 
@@ -0,0 +1,88 @@
+#include <getopt.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "Benchmark.h"
+#include "TaskSysConfig.h"
+#include "TaskSysStats.h"
+
+#include "launch_ispc.h"
+
+using namespace ispc;
+
+const int kRuns = 3;
+
+int gLaunches = 10000;
+int gTasks = 288;  // Same as SqrtISPCTasks
+
+// Specify expected options and usage
+const char* kShortOptions = "n:s:h";
+const struct option kLongOptions[] = {{"launches", required_argument, nullptr, 'n'},
+                                      {"tasks", required_argument, nullptr, 's'},
+                                      {"help", no_argument, nullptr, 'h'},
+                                      {nullptr, 0, nullptr, 0}};
+
+void PrintUsage(const char* program_name) {
+  printf("Usage: %s [options]\n", program_name);
+  printf("Options:\n");
+  printf("  -n  --launches <INT> Number of launches, default: %d\n", gLaunches);
+  printf("  -s  --tasks <INT>    Tasks per launch, default: %d\n", gTasks);
+  printf("  -h  --help           Print this message\n");
+}
+
+int main(int argc, char** argv) {
+  {
+    int opt;
+    while ((opt = getopt_long(argc, argv, kShortOptions, kLongOptions, nullptr)) != -1) {
+      switch (opt) {
+        case 'n':
+          gLaunches = atoi(optarg);
+          break;
+        case 's':
+          gTasks = atoi(optarg);
+          break;
+        case 'h':
+          PrintUsage(argv[0]);
+          return 0;
+        case '?':  // Unrecognized option
+        default:
+          PrintUsage(argv[0]);
+          return 1;
+      }
+    }
+  }
+  if (gLaunches < 1 || gTasks < 1) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  // Measures the overhead of the ISPC task system (common/tasksys.cc), since the tasks themselves
+  // do almost nothing
+  std::vector<int> counts(gTasks, 0);
+
+  // Warm up the task system (thread creation and the first task group) so that the counters only
+  // cover steady-state launches
+  LaunchTinyTasks(1, gTasks, counts.data());
+  ResetTaskSysStats();
+
+  double min_time = Benchmark(kRuns, LaunchTinyTasks, gLaunches, gTasks, counts.data());
+  TaskSysStats stats = GetTaskSysStats();
+  for (int i = 0; i < gTasks; i++) {
+    if (counts[i] != kRuns * gLaunches + 1) {
+      fprintf(stderr, "Error: Task %d ran %d times, expected %d\n", i, counts[i],
+              kRuns * gLaunches + 1);
+      return 1;
+    }
+  }
+
+  TaskSysConfig config = GetTaskSysConfig();
+  printf("[task system]:\t\t\t\t%s\t%d threads\tCPUs %s\tSMT %s\n", GetTaskSysBackend(),
+         config.numThreads, config.cpus.c_str(), config.smt ? "on" : "off");
+  printf("[launch[%d] tiny tasks]:\t\t%.3f ms\t%.3f us per launch\t%.1f ns per task\n", gTasks,
+         min_time * 1000, min_time * 1e6 / gLaunches,
+         min_time * 1e9 / (static_cast<double>(gLaunches) * gTasks));
+  printf("[launch[%d] tiny tasks]:\t\t%lld launches\t%lld heap allocations (%lld bytes)\n", gTasks,
+         static_cast<long long>(stats.launches), static_cast<long long>(stats.heapAllocations),
+         static_cast<long long>(stats.heapBytes));
+  return 0;
+}
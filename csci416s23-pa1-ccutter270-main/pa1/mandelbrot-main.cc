@@ -3,6 +3,7 @@
 #include <limits>
 #include "Benchmark.h"
 #include "CycleTimer.h"
+#include "TaskSysConfig.h"
 
 // Uncomment the following line if you run into errors with std::align_val_t
 //#define NO_ALIGN_VAL
@@ -23,11 +24,13 @@ const int kMaxIterations = 256;
 
 int gTasks = 1;
 int gThreads = 1;
+int gTileSize = 32;
 
 // Specify expected options and usage
-const char* kShortOptions = "s:t:h";
+const char* kShortOptions = "s:t:T:h";
 const struct option kLongOptions[] = {{"tasks", required_argument, nullptr, 's'},
                                       {"threads", required_argument, nullptr, 't'},
+                                      {"tile", required_argument, nullptr, 'T'},
                                       {"help", no_argument, nullptr, 'h'},
                                       {nullptr, 0, nullptr, 0}};
 
@@ -38,6 +41,8 @@ void PrintUsage(const char* program_name) {
   printf(
       "  -t  --threads <INT>  Run C++ threads implementation with specified threads, default: %d\n",
       gThreads);
+  printf("  -T  --tile <INT>     Run ISPC tiled implementation with INTxINT tiles, default: %d\n",
+         gTileSize);
   printf("  -h  --help         Print this message\n");
 }
 
@@ -73,6 +78,9 @@ int main(int argc, char** argv) {
         case 's':
           gTasks = atoi(optarg);
           break;
+        case 'T':
+          gTileSize = atoi(optarg);
+          break;
         case 'h':
           PrintUsage(argv[0]);
           return 0;
@@ -83,6 +91,10 @@ int main(int argc, char** argv) {
       }
     }
   }
+  if (gTileSize < 1) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
 
   float x0 = -2;
   float x1 = 1;
@@ -139,6 +151,30 @@ int main(int argc, char** argv) {
   }
   WritePPM(output_test, kWidth, kHeight, "mandelbrot-ispc-tasks.ppm");
 
+  // The same tiles handed out in each dispatch order
+  const struct {
+    TaskDispatch dispatch;
+    const char* name;
+  } kDispatches[] = {{TaskDispatch::kLinear, "linear"},
+                     {TaskDispatch::kMorton, "morton"},
+                     {TaskDispatch::kHilbert, "hilbert"}};
+  TaskDispatch initial_dispatch = GetTaskDispatch();
+  for (const auto& dispatch : kDispatches) {
+    SetTaskDispatch(dispatch.dispatch);
+    ResetImageOutput(kWidth, kHeight, output_test);
+    double min_ispc_tiles = Benchmark(kRuns, MandelbrotISPCTiledTasks, x0, y0, x1, y1, kWidth,
+                                      kHeight, kMaxIterations, output_test, gTileSize);
+    printf("[mandelbrot ispc %dx%d tiles %s]:\t%.3f ms\t%.3fX speedup\n", gTileSize, gTileSize,
+           dispatch.name, min_ispc_tiles * 1000, min_serial / min_ispc_tiles);
+    if (!CompareMandelbrotResults(kWidth, kHeight, output_ref, output_test)) {
+      fprintf(stderr, "ispc tiles[%d] %s implementation doesn't match serial implementation\n",
+              gTileSize, dispatch.name);
+      return 1;
+    }
+  }
+  SetTaskDispatch(initial_dispatch);
+  WritePPM(output_test, kWidth, kHeight, "mandelbrot-ispc-tiles.ppm");
+
   #ifndef NO_ALIGN_VAL
   delete[] output_ref;
   delete[] output_test;
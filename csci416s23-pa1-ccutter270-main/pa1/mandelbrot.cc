@@ -1,7 +1,7 @@
 #include "mandelbrot.h"
 #include <algorithm>
-#include <thread>
 #include "CycleTimer.h"
+#include "SharedTaskRunner.h"
 #include <stdio.h>
 
 namespace {
@@ -51,36 +51,14 @@ void MandelbrotThreads(float x0, float y0, float x1, float y1, int width, int he
                        int maxIterations, int output[], int num_threads) {
 
   // TODO: Implement the computation using C++ threads with num_threads. Be mindful of edge conditions
-  
-  // Initiate workers threads
-  std::thread workers[num_threads];
-
-  // Calculate rows per thread & current 
-  int rows_per_thread = height / num_threads;     // this stays constant 
-  int curr_height = 0;                            // this increments each iteration
-
-  
-  // Iterate to create num_threads - 1 (master thread after) (bottom --> up )
-  for (int i = 0; i < num_threads - 1; i++) {
-
-        // Create threads
 
-        // i is thread id, and num thread
-        workers[i] = std::thread(MandelbrotThread, x0, y0, x1, y1, width, height, maxIterations, output,
-                           curr_height, (curr_height + rows_per_thread), 0, width, i, num_threads);
-
-        // Increment curr_height
-        curr_height = curr_height + rows_per_thread;
-    }
-
-  // Main thread is top part (curr_height --> height)
-    MandelbrotThread(x0, y0, x1, y1, width, height, maxIterations, output, curr_height, height, 0,
-                    width, num_threads - 1, num_threads);
-
-  // Join the worker threads 
-  for (int i = 0; i < num_threads - 1; i++) {
-    workers[i].join();
-  }
+  // Run the num_threads interleaved slices of rows as tasks on the thread pool shared with the ISPC
+  // task system, rather than starting threads of our own that would compete with its workers. The
+  // calling thread works on the slices too while it waits.
+  SharedTaskRunner::Instance().Run(num_threads, [&](int thread_id, int total_threads) {
+    MandelbrotThread(x0, y0, x1, y1, width, height, maxIterations, output, 0, height, 0, width,
+                     thread_id, total_threads);
+  });
 
 // PROF LINDERMAN STARRT CODE W/ 2 THREADS
 
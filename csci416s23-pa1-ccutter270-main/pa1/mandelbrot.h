@@ -34,6 +34,9 @@ void MandelbrotSerial(float x0, float y0, float x1, float y1, int width, int hei
  * @brief Compute iterations needed to determine if pixel is in the Mandelbrot set using multiple
  * threads
  *
+ * The work is split into num_threads tasks executed by the shared thread pool (SharedTaskRunner.h),
+ * so at most SharedTaskRunner::NumThreads() of them run concurrently.
+ *
  * @param x0 Mandelbrot set parameters
  * @param y0 Mandelbrot set parameters
  * @param x1 Mandelbrot set parameters
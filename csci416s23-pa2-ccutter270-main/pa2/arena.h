@@ -0,0 +1,108 @@
+/**
+ * @file arena.h
+ *
+ * Bump-pointer allocator for scratch memory that is freed all at once
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Single-threaded bump-pointer allocator
+ *
+ * Allocations carve space out of a list of blocks and are never freed individually. Instead the
+ * owner takes a Mark and later Releases everything allocated since then, in stack order. Blocks
+ * are kept across releases, so once the arena has grown to the peak usage allocating is just a
+ * pointer increment into memory that is likely still in cache.
+ */
+class ScratchArena {
+ public:
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  struct Marker {
+    size_t block;
+    size_t offset;
+  };
+
+  ScratchArena() : block_(0), offset_(0) {}
+
+  ScratchArena(const ScratchArena&) = delete;
+  ScratchArena& operator=(const ScratchArena&) = delete;
+
+  /**
+   * @brief Allocate size bytes aligned to align (a power of two), valid until released
+   */
+  void* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    if (block_ < blocks_.size()) {
+      void* ptr = AllocateInBlock(blocks_[block_], size, align);
+      if (ptr != nullptr) return ptr;
+    }
+    return AllocateSlow(size, align);
+  }
+
+  /**
+   * @brief Allocate uninitialized space for n objects of the trivial type T
+   */
+  template <typename T>
+  T* AllocateArray(size_t n) {
+    static_assert(std::is_trivial<T>::value, "Arena memory is never constructed or destroyed");
+    return static_cast<T*>(Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  Marker Mark() const { return Marker{block_, offset_}; }
+
+  /**
+   * @brief Free everything allocated since marker was taken
+   */
+  void Release(Marker marker) {
+    block_ = marker.block;
+    offset_ = marker.offset;
+  }
+
+  void Reset() { Release(Marker{0, 0}); }
+
+  /**
+   * @brief Total size of the blocks held by the arena
+   */
+  size_t Capacity() const {
+    size_t capacity = 0;
+    for (const Block& block : blocks_) capacity += block.size;
+    return capacity;
+  }
+
+ private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  void* AllocateInBlock(const Block& block, size_t size, size_t align) {
+    uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+    uintptr_t start = (base + offset_ + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    if (start + size > base + block.size) return nullptr;
+    offset_ = start + size - base;
+    return reinterpret_cast<void*>(start);
+  }
+
+  void* AllocateSlow(size_t size, size_t align) {
+    // Move on to the next block with enough room, skipping any that are too small
+    while (++block_ < blocks_.size()) {
+      offset_ = 0;
+      void* ptr = AllocateInBlock(blocks_[block_], size, align);
+      if (ptr != nullptr) return ptr;
+    }
+    size_t block_size = std::max(kBlockSize, size + align);
+    blocks_.push_back(Block{std::unique_ptr<char[]>(new char[block_size]), block_size});
+    block_ = blocks_.size() - 1;
+    offset_ = 0;
+    return AllocateInBlock(blocks_[block_], size, align);
+  }
+
+  std::vector<Block> blocks_;
+  size_t block_;   // Block we are allocating from
+  size_t offset_;  // Offset of the first free byte in that block
+};
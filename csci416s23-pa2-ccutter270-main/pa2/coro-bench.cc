@@ -0,0 +1,222 @@
+/**
+ * @file coro-bench.cc
+ *
+ * Run thousands of concurrent pipelines of launches as coroutines, compared to running each
+ * pipeline with blocking Run calls
+ */
+#include <getopt.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "CycleTimer.h"
+#include "coro.h"
+#include "runners.h"
+#include "tasksys.h"
+
+const int kRuns = 3;
+int gThreads = 8;
+int gPipelines = 4096;
+int gStages = 8;
+int gTasks = 4;
+int gElements = 256;
+SchedulePolicy gSchedule = SchedulePolicy::kGuided;
+
+// Specify expected options and usage
+const char* kShortOptions = "t:p:n:k:e:r:s:h";
+const struct option kLongOptions[] = {{"threads", required_argument, nullptr, 't'},
+                                      {"pipelines", required_argument, nullptr, 'p'},
+                                      {"stages", required_argument, nullptr, 'n'},
+                                      {"tasks", required_argument, nullptr, 'k'},
+                                      {"elements", required_argument, nullptr, 'e'},
+                                      {"runner", required_argument, nullptr, 'r'},
+                                      {"schedule", required_argument, nullptr, 's'},
+                                      {"help", no_argument, nullptr, 'h'},
+                                      {nullptr, 0, nullptr, 0}};
+
+void PrintUsage(const char* program_name) {
+  printf("Usage: %s [options]\n", program_name);
+  printf("Options:\n");
+  printf("  -t --threads <INT>    Number of threads, default: %d\n", gThreads);
+  printf("  -p --pipelines <INT>  Number of pipelines, default: %d\n", gPipelines);
+  printf("  -n --stages <INT>     Launches per pipeline, default: %d\n", gStages);
+  printf("  -k --tasks <INT>      Tasks per launch, default: %d\n", gTasks);
+  printf("  -e --elements <INT>   Elements updated by each launch, default: %d\n", gElements);
+  printf("  -r --runner <NAME>    Only measure the runner with <NAME>, default: pool runners\n");
+  printf("  -s --schedule <NAME>  Task schedule for pool runners (dynamic, static, guided), "
+         "default: guided\n");
+  printf("  -h --help             Print this message\n");
+}
+
+/**
+ * @brief Add a stage's increment to each element, split evenly among the tasks
+ */
+class StageTask : public Runnable {
+ public:
+  StageTask(std::vector<int>& data, int increment) : data_(data), increment_(increment) {}
+
+  void RunTask(int task_id, int num_tasks) override {
+    int size = data_.size();
+    int begin = static_cast<int64_t>(size) * task_id / num_tasks;
+    int end = static_cast<int64_t>(size) * (task_id + 1) / num_tasks;
+    for (int i = begin; i < end; i++) data_[i] += increment_;
+  }
+
+ private:
+  std::vector<int>& data_;
+  int increment_;
+};
+
+/**
+ * @brief Check that every stage was applied exactly once
+ */
+bool CheckPipeline(const std::vector<int>& data) {
+  int expected = gStages * (gStages + 1) / 2;
+  for (int value : data) {
+    if (value != expected) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Pipeline that suspends while each of its launches runs
+ */
+CoTask CoroutinePipeline(CoRunner& runner, std::atomic<int>& num_correct) {
+  co_await runner.Schedule();
+  std::vector<int> data(gElements, 0);
+  for (int stage = 1; stage <= gStages; stage++) {
+    StageTask task(data, stage);
+    co_await runner.RunAsync(&task, gTasks);
+  }
+  if (CheckPipeline(data)) num_correct.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Run all of the pipelines concurrently as coroutines
+ * @return Elapsed time in seconds, or a negative value if a pipeline was incorrect
+ */
+double RunCoroutines(TaskRunner& task_runner) {
+  CoRunner runner(task_runner);
+  std::atomic<int> num_correct(0);
+
+  double start_time = CycleTimer::currentSeconds();
+  for (int i = 0; i < gPipelines; i++) CoroutinePipeline(runner, num_correct);
+  // Each pipeline has a launch in flight until it finishes, so Sync waits for all of them
+  task_runner.Sync();
+  double end_time = CycleTimer::currentSeconds();
+
+  if (num_correct.load() != gPipelines) return -1.;
+  return end_time - start_time;
+}
+
+/**
+ * @brief Run the pipelines one at a time, blocking in Run for each launch
+ * @return Elapsed time in seconds, or a negative value if a pipeline was incorrect
+ */
+double RunBlocking(TaskRunner& runner) {
+  int num_correct = 0;
+
+  double start_time = CycleTimer::currentSeconds();
+  for (int i = 0; i < gPipelines; i++) {
+    std::vector<int> data(gElements, 0);
+    for (int stage = 1; stage <= gStages; stage++) {
+      StageTask task(data, stage);
+      runner.Run(&task, gTasks);
+    }
+    if (CheckPipeline(data)) num_correct++;
+  }
+  double end_time = CycleTimer::currentSeconds();
+
+  if (num_correct != gPipelines) return -1.;
+  return end_time - start_time;
+}
+
+/**
+ * @brief Report the fastest of kRuns runs of benchmark
+ */
+bool Report(const char* name, TaskRunner& runner, double (*benchmark)(TaskRunner&)) {
+  double min_time = -1.;
+  for (int i = 0; i < kRuns; i++) {
+    double time = benchmark(runner);
+    if (time < 0) {
+      printf("  [%s]:\t\tIncorrect result\n", name);
+      return false;
+    }
+    if (min_time < 0 || time < min_time) min_time = time;
+  }
+  double launches = static_cast<double>(gPipelines) * gStages;
+  printf("  [%s]:\t\t%.3f ms\t%.2f Mlaunches/s\n", name, min_time * 1000,
+         launches / min_time * 1e-6);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  std::string test_runner;
+  int opt;
+  while ((opt = getopt_long(argc, argv, kShortOptions, kLongOptions, nullptr)) != -1) {
+    switch (opt) {
+      case 't':
+        gThreads = atoi(optarg);
+        break;
+      case 'p':
+        gPipelines = atoi(optarg);
+        break;
+      case 'n':
+        gStages = atoi(optarg);
+        break;
+      case 'k':
+        gTasks = atoi(optarg);
+        break;
+      case 'e':
+        gElements = atoi(optarg);
+        break;
+      case 'r':
+        test_runner = optarg;
+        break;
+      case 's':
+        if (!ParseSchedulePolicy(optarg, &gSchedule)) {
+          fprintf(stderr, "Error: Unknown schedule %s\n", optarg);
+          PrintUsage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'h':
+        PrintUsage(argv[0]);
+        return 0;
+      case '?':  // Unrecognized option
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+  if (gThreads < 1 || gPipelines < 1 || gStages < 1 || gTasks < 1 || gElements < 1) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  printf("Coroutine pipelines [%d pipelines of %d launches of %d tasks, %d threads]\n", gPipelines,
+         gStages, gTasks, gThreads);
+  bool correct = true;
+  for (int i = 0; i < static_cast<int>(TaskRunnerKind::kMaxKind); i++) {
+    auto kind = static_cast<TaskRunnerKind>(i);
+    const char* runner_name = TaskRunnerName(kind);
+    if (test_runner.empty()) {
+      // Only the pool runners launch asynchronously, the others resume coroutines within co_await
+      if (kind != TaskRunnerKind::kSpin && kind != TaskRunnerKind::kSleep &&
+          kind != TaskRunnerKind::kHybrid) {
+        continue;
+      }
+    } else if (test_runner != runner_name) {
+      continue;
+    }
+
+    printf("[%s]\n", runner_name);
+    TaskRunner* runner = TaskRunnerFactory(kind, gThreads, gSchedule, PlacementPolicy::kNone);
+    correct = Report("Coroutines", *runner, RunCoroutines) && correct;
+    correct = Report("Blocking", *runner, RunBlocking) && correct;
+    delete runner;
+    fflush(stdout);
+  }
+  return correct ? 0 : 1;
+}
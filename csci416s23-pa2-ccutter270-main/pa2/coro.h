@@ -0,0 +1,152 @@
+/**
+ * @file coro.h
+ *
+ * C++20 coroutine front end for the task runners (requires compiling with C++20)
+ */
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include "tasksys.h"
+
+/**
+ * @brief Return type for fire-and-forget coroutines
+ *
+ * The coroutine starts running immediately and its frame is destroyed when it completes.
+ */
+class CoTask {
+ public:
+  struct promise_type {
+    CoTask get_return_object() { return CoTask(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+/**
+ * @brief Awaitable operations that resume the awaiting coroutine on one of a runner's threads
+ *
+ * Awaiting does not block a thread: the coroutine is suspended and resumed by the worker that
+ * executes the last task of the launch, so any number of coroutines can be in flight. The
+ * resumption is only asynchronous if the runner's RunAsyncWithDeps is (e.g. the pool runners);
+ * with other runners the launch and resumption happen within the co_await.
+ *
+ * Note that the pool runners' Sync (and destructor) also wait for coroutines resumed in the pool,
+ * as long as each one awaits its next operation before returning control to the pool.
+ */
+class CoRunner {
+ public:
+  explicit CoRunner(TaskRunner& runner) : runner_(runner) {}
+
+  TaskRunner& Runner() { return runner_; }
+
+  /**
+   * @brief co_await Schedule() to continue the coroutine on one of the runner's threads
+   */
+  auto Schedule() { return ScheduleAwaiter(runner_); }
+
+  /**
+   * @brief co_await RunAsync(runnable, num_tasks) to launch tasks and continue once they complete
+   */
+  auto RunAsync(Runnable* runnable, int num_tasks) {
+    return LaunchAwaiter(runner_, runnable, num_tasks);
+  }
+
+ private:
+  /**
+   * @brief Launch of a single task that resumes a coroutine
+   *
+   * Resuming may destroy the awaiter that owns this runnable, so resuming must be the last thing
+   * RunTask and RunRange do.
+   */
+  class ResumeRunnable : public Runnable {
+   public:
+    void RunTask(int task_id, int num_tasks) override {
+      std::coroutine_handle<> handle = handle_;
+      handle.resume();
+    }
+    void RunRange(int begin, int end, int num_tasks) override {
+      std::coroutine_handle<> handle = handle_;
+      handle.resume();
+    }
+
+    std::coroutine_handle<> handle_;
+  };
+
+  /**
+   * @brief Wraps a runnable to resume a coroutine once all of its tasks have completed
+   */
+  class CompletionRunnable : public Runnable {
+   public:
+    CompletionRunnable(Runnable* runnable, int num_tasks)
+        : runnable_(runnable), num_remaining_(num_tasks) {}
+
+    void RunTask(int task_id, int num_tasks) override { RunRange(task_id, task_id + 1, num_tasks); }
+    void RunRange(int begin, int end, int num_tasks) override {
+      runnable_->RunRange(begin, end, num_tasks);
+      Finish(end - begin);
+    }
+    void RunRange(int begin, int end, int num_tasks, TaskContext& context) override {
+      runnable_->RunRange(begin, end, num_tasks, context);
+      Finish(end - begin);
+    }
+    double TaskCost(int task_id, int num_tasks) const override {
+      return runnable_->TaskCost(task_id, num_tasks);
+    }
+
+    std::coroutine_handle<> handle_;
+
+   private:
+    void Finish(int count) {
+      if (num_remaining_.fetch_sub(count, std::memory_order_acq_rel) == count) {
+        std::coroutine_handle<> handle = handle_;
+        handle.resume();
+      }
+    }
+
+    Runnable* runnable_;
+    std::atomic<int> num_remaining_;
+  };
+
+  class ScheduleAwaiter {
+   public:
+    explicit ScheduleAwaiter(TaskRunner& runner) : runner_(runner) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      resume_.handle_ = handle;
+      // The coroutine may be resumed (and this awaiter destroyed) before the launch returns
+      TaskRunner& runner = runner_;
+      runner.RunAsyncWithDeps(&resume_, 1, {});
+    }
+    void await_resume() const noexcept {}
+
+   private:
+    TaskRunner& runner_;
+    ResumeRunnable resume_;
+  };
+
+  class LaunchAwaiter {
+   public:
+    LaunchAwaiter(TaskRunner& runner, Runnable* runnable, int num_tasks)
+        : runner_(runner), num_tasks_(num_tasks), completion_(runnable, num_tasks) {}
+
+    bool await_ready() const noexcept { return num_tasks_ <= 0; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      completion_.handle_ = handle;
+      TaskRunner& runner = runner_;
+      int num_tasks = num_tasks_;
+      runner.RunAsyncWithDeps(&completion_, num_tasks, {});
+    }
+    void await_resume() const noexcept {}
+
+   private:
+    TaskRunner& runner_;
+    int num_tasks_;
+    CompletionRunnable completion_;
+  };
+
+  TaskRunner& runner_;
+};
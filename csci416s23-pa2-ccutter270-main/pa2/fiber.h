@@ -0,0 +1,63 @@
+/**
+ * @file fiber.h
+ *
+ * Minimal user-space fibers built on ucontext
+ */
+#pragma once
+#include <ucontext.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Execution context that can be switched to and from on a single thread
+ *
+ * A default-constructed Fiber has no stack of its own and stores the context of the thread that
+ * switches away from it (e.g. a scheduler loop). Fibers with a stack run an entry function that
+ * must never return, since there is no context to return to; it should instead switch back to the
+ * fiber that scheduled it.
+ */
+class Fiber {
+ public:
+  static constexpr size_t kDefaultStackSize = 256 * 1024;
+
+  Fiber() : stack_size_(0), entry_(nullptr), arg_(nullptr) {}
+  explicit Fiber(size_t stack_size)
+      : stack_(new char[stack_size]), stack_size_(stack_size), entry_(nullptr), arg_(nullptr) {}
+
+  Fiber(const Fiber&) = delete;
+  Fiber& operator=(const Fiber&) = delete;
+
+  /**
+   * @brief Prepare the fiber to run entry(arg) on its stack when it is first switched to
+   */
+  void Start(void (*entry)(void*), void* arg) {
+    entry_ = entry;
+    arg_ = arg;
+    getcontext(&context_);
+    context_.uc_stack.ss_sp = stack_.get();
+    context_.uc_stack.ss_size = stack_size_;
+    context_.uc_link = nullptr;
+    // makecontext only passes int arguments, so we pass this in two halves
+    uintptr_t self = reinterpret_cast<uintptr_t>(this);
+    makecontext(&context_, reinterpret_cast<void (*)()>(&Fiber::Trampoline), 2,
+                static_cast<uint32_t>(self >> 32), static_cast<uint32_t>(self));
+  }
+
+  /**
+   * @brief Save the current context in from and resume to
+   */
+  static void Switch(Fiber& from, Fiber& to) { swapcontext(&from.context_, &to.context_); }
+
+ private:
+  static void Trampoline(uint32_t high, uint32_t low) {
+    Fiber* fiber = reinterpret_cast<Fiber*>((static_cast<uintptr_t>(high) << 32) | low);
+    fiber->entry_(fiber->arg_);
+  }
+
+  ucontext_t context_;
+  std::unique_ptr<char[]> stack_;
+  size_t stack_size_;
+  void (*entry_)(void*);
+  void* arg_;
+};
@@ -0,0 +1,153 @@
+/**
+ * @file latency-bench.cc
+ *
+ * Measure the fixed cost of TaskRunner::Run by launching empty tasks, reporting the distribution
+ * of per-launch latencies for each runner, thread count and number of tasks
+ */
+#include <getopt.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "runners.h"
+#include "tasksys.h"
+
+int gThreads = 8;
+int gMaxTasks = 4096;
+int gLaunches = 2000;
+SchedulePolicy gSchedule = SchedulePolicy::kGuided;
+
+// Specify expected options and usage
+const char* kShortOptions = "t:m:i:r:s:h";
+const struct option kLongOptions[] = {{"threads", required_argument, nullptr, 't'},
+                                      {"max-tasks", required_argument, nullptr, 'm'},
+                                      {"launches", required_argument, nullptr, 'i'},
+                                      {"runner", required_argument, nullptr, 'r'},
+                                      {"schedule", required_argument, nullptr, 's'},
+                                      {"help", no_argument, nullptr, 'h'},
+                                      {nullptr, 0, nullptr, 0}};
+
+void PrintUsage(const char* program_name) {
+  printf("Usage: %s [options]\n", program_name);
+  printf("Options:\n");
+  printf("  -t --threads <INT>    Maximum number of threads (powers of two below it, then it), "
+         "default: %d\n",
+         gThreads);
+  printf("  -m --max-tasks <INT>  Maximum tasks per launch (powers of four below it, then it), "
+         "default: %d\n",
+         gMaxTasks);
+  printf("  -i --launches <INT>   Timed launches per configuration, default: %d\n", gLaunches);
+  printf("  -r --runner <NAME>    Only measure the runner with <NAME>\n");
+  printf("  -s --schedule <NAME>  Task schedule for pool runners (dynamic, static, guided), "
+         "default: guided\n");
+  printf("  -h --help             Print this message\n");
+}
+
+/**
+ * @brief Task that does nothing, so that we only measure the runner
+ */
+class EmptyTask : public Runnable {
+ public:
+  void RunTask(int task_id, int num_tasks) override {}
+};
+
+/**
+ * @brief Value below which the fraction q of the sorted samples fall (nearest rank)
+ */
+int64_t Percentile(const std::vector<int64_t>& sorted, double q) {
+  size_t rank = static_cast<size_t>(q * sorted.size());
+  return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+/**
+ * @brief Time gLaunches launches of num_tasks empty tasks
+ * @return Latency of each launch in nanoseconds, sorted
+ */
+std::vector<int64_t> MeasureLaunches(TaskRunner& runner, int num_tasks) {
+  // Warm up the threads (and any adaptive state such as spin limits) before timing
+  const int kWarmupLaunches = 100;
+  EmptyTask task;
+  for (int i = 0; i < kWarmupLaunches; i++) runner.Run(&task, num_tasks);
+
+  std::vector<int64_t> latencies(gLaunches);
+  for (int i = 0; i < gLaunches; i++) {
+    auto start = std::chrono::steady_clock::now();
+    runner.Run(&task, num_tasks);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  }
+  std::sort(latencies.begin(), latencies.end());
+  return latencies;
+}
+
+int main(int argc, char** argv) {
+  std::string test_runner;
+  int opt;
+  while ((opt = getopt_long(argc, argv, kShortOptions, kLongOptions, nullptr)) != -1) {
+    switch (opt) {
+      case 't':
+        gThreads = atoi(optarg);
+        break;
+      case 'm':
+        gMaxTasks = atoi(optarg);
+        break;
+      case 'i':
+        gLaunches = atoi(optarg);
+        break;
+      case 'r':
+        test_runner = optarg;
+        break;
+      case 's':
+        if (!ParseSchedulePolicy(optarg, &gSchedule)) {
+          fprintf(stderr, "Error: Unknown schedule %s\n", optarg);
+          PrintUsage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'h':
+        PrintUsage(argv[0]);
+        return 0;
+      case '?':  // Unrecognized option
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+  if (gThreads < 1 || gMaxTasks < 1 || gLaunches < 1) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  printf("Launch latency [%d launches of empty tasks, times in us]\n", gLaunches);
+  for (int i = 0; i < static_cast<int>(TaskRunnerKind::kMaxKind); i++) {
+    auto kind = static_cast<TaskRunnerKind>(i);
+    const char* runner_name = TaskRunnerName(kind);
+    if (!test_runner.empty() && test_runner != runner_name) {
+      continue;
+    }
+
+    printf("[%s]\n", runner_name);
+    printf("  %7s %7s %10s %10s %10s %10s\n", "threads", "tasks", "p50", "p90", "p99", "max");
+    // Powers of two, ending with gThreads even if it isn't one
+    for (int num_threads = 1; num_threads <= gThreads;
+         num_threads = num_threads == gThreads ? num_threads + 1
+                                               : std::min(num_threads * 2, gThreads)) {
+      TaskRunner* runner =
+          TaskRunnerFactory(kind, num_threads, gSchedule, PlacementPolicy::kNone);
+      // Powers of four, ending with gMaxTasks even if it isn't one
+      for (int num_tasks = 1; num_tasks <= gMaxTasks;
+           num_tasks = num_tasks == gMaxTasks ? num_tasks + 1
+                                              : std::min(num_tasks * 4, gMaxTasks)) {
+        std::vector<int64_t> latencies = MeasureLaunches(*runner, num_tasks);
+        printf("  %7d %7d %10.2f %10.2f %10.2f %10.2f\n", num_threads, num_tasks,
+               Percentile(latencies, 0.5) * 1e-3, Percentile(latencies, 0.9) * 1e-3,
+               Percentile(latencies, 0.99) * 1e-3, latencies.back() * 1e-3);
+      }
+      delete runner;
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -1,18 +1,30 @@
 #include <getopt.h>
 #include <cstdio>
 #include <cstdlib>
+#include <string>
+#include "runners.h"
 #include "tasksys.h"
 #include "test/tasks.h"
 
 const int kRuns = 3;
 int gThreads = 1;
+SchedulePolicy gSchedule = SchedulePolicy::kGuided;
+PlacementPolicy gPlacement = PlacementPolicy::kNone;
+bool gStats = false;
+int gElasticMin = 0;  // Minimum threads for elastic pool runners, 0 for a fixed size
+std::string gTracePath;  // Chrome trace output, empty if not tracing
 
 // Specify expected options and usage
-const char* kShortOptions = "t:n:lr:h";
+const char* kShortOptions = "t:n:lr:s:p:e:ST:h";
 const struct option kLongOptions[] = {{"threads", required_argument, nullptr, 't'},
                                       {"name", required_argument, nullptr, 'n'},
                                       {"list", no_argument, nullptr, 'l'},
                                       {"runner", required_argument, nullptr, 'r'},
+                                      {"schedule", required_argument, nullptr, 's'},
+                                      {"placement", required_argument, nullptr, 'p'},
+                                      {"elastic", required_argument, nullptr, 'e'},
+                                      {"stats", no_argument, nullptr, 'S'},
+                                      {"trace", required_argument, nullptr, 'T'},
                                       {"help", no_argument, nullptr, 'h'},
                                       {nullptr, 0, nullptr, 0}};
 
@@ -25,45 +37,46 @@ void PrintUsage(const char* program_name) {
   printf("  -n --name <NAME>     Run the test with <NAME>\n");
   printf("  -l --list            List the available tests and exit\n");
   printf("  -r --runner <NAME>   Use the test runner with <NAME>\n");
+  printf("  -s --schedule <NAME> Task schedule for pool runners (dynamic, static, guided), default: "
+         "guided\n");
+  printf("  -p --placement <NAME> Pin pool threads (none, cores, socket) and print the placement, "
+         "default: none\n");
+  printf("  -e --elastic <INT>   Let pool runners shrink to <INT> threads when idle and grow back "
+         "under load\n");
+  printf("  -S --stats           Print per-worker scheduling statistics for the fastest run\n");
+  printf("  -T --trace <FILE>    Write a Chrome trace of the fastest run of each test and runner "
+         "to <FILE>\n");
   printf("  -h  --help           Print this message\n");
 }
 
-enum class TaskRunnerKind : int {
-  kSerial = 0,
-  kSpawn,
-  kSpin,
-  kSleep,
-  kMaxKind,
-};
-
-TaskRunner* TaskRunnerFactory(TaskRunnerKind kind, int num_threads) {
-  switch (kind) {
-    case TaskRunnerKind::kSerial:
-      return new TaskRunnerSerial();
-    case TaskRunnerKind::kSpawn:
-      return new TaskRunnerSpawn(num_threads);
-    case TaskRunnerKind::kSpin:
-      return new TaskRunnerSpin(num_threads);
-    case TaskRunnerKind::kSleep:
-      return new TaskRunnerSleep(num_threads);
-    default:
-      return nullptr;
+/**
+ * @brief Print a compact table of the per-worker counters and launch latencies
+ */
+void PrintStats(const RunnerStats& stats) {
+  int64_t num_tasks = 0;
+  for (const WorkerStats& worker : stats.workers) num_tasks += worker.tasks;
+  if (num_tasks == 0) {
+    printf("  (no statistics for this runner)\n");
+    return;
   }
-}
-
-const char* TaskRunnerName(TaskRunnerKind kind) {
-  switch (kind) {
-    case TaskRunnerKind::kSerial:
-      return "TaskRunnerSerial";
-    case TaskRunnerKind::kSpawn:
-      return "TaskRunnerSpawn";
-    case TaskRunnerKind::kSpin:
-      return "TaskRunnerSpin";
-    case TaskRunnerKind::kSleep:
-      return "TaskRunnerSleep";
-    default:
-      assert(false);
-      return "";
+  printf("  %6s %10s %10s %10s %8s %8s %8s\n", "worker", "tasks", "busy ms", "idle ms", "claims",
+         "steals", "wakeups");
+  for (size_t i = 0; i < stats.workers.size(); i++) {
+    const WorkerStats& worker = stats.workers[i];
+    printf("  %6zu %10lld %10.3f %10.3f %8lld %8lld %8lld\n", i,
+           static_cast<long long>(worker.tasks), worker.busy_ns * 1e-6, worker.idle_ns * 1e-6,
+           static_cast<long long>(worker.claims), static_cast<long long>(worker.steals),
+           static_cast<long long>(worker.wakeups));
+  }
+  if (stats.launches > 0) {
+    printf("  launch to first task:\tavg %.2f us\tmax %.2f us\t(%lld launches)\n",
+           stats.first_task_ns * 1e-3 / stats.launches, stats.max_first_task_ns * 1e-3,
+           static_cast<long long>(stats.launches));
+  }
+  if (stats.returns > 0) {
+    printf("  last task to return:\tavg %.2f us\tmax %.2f us\t(%lld returns)\n",
+           stats.return_ns * 1e-3 / stats.returns, stats.max_return_ns * 1e-3,
+           static_cast<long long>(stats.returns));
   }
 }
 
@@ -88,6 +101,29 @@ int main(int argc, char** argv) {
         case 'r':
           test_runner = optarg;
           break;
+        case 's':
+          if (!ParseSchedulePolicy(optarg, &gSchedule)) {
+            fprintf(stderr, "Error: Unknown schedule %s\n", optarg);
+            PrintUsage(argv[0]);
+            return 1;
+          }
+          break;
+        case 'p':
+          if (!ParsePlacementPolicy(optarg, &gPlacement)) {
+            fprintf(stderr, "Error: Unknown placement %s\n", optarg);
+            PrintUsage(argv[0]);
+            return 1;
+          }
+          break;
+        case 'e':
+          gElasticMin = atoi(optarg);
+          break;
+        case 'S':
+          gStats = true;
+          break;
+        case 'T':
+          gTracePath = optarg;
+          break;
         case 'h':
           PrintUsage(argv[0]);
           return 0;
@@ -99,6 +135,29 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (gPlacement != PlacementPolicy::kNone) {
+    // Report where each of the pinned runners places its threads
+    for (int i = 0; i < static_cast<int>(TaskRunnerKind::kMaxKind); i++) {
+      const char* runner_name = TaskRunnerName(static_cast<TaskRunnerKind>(i));
+      if (!test_runner.empty() && test_runner != runner_name) {
+        continue;
+      }
+      TaskRunner* runner =
+          TaskRunnerFactory(static_cast<TaskRunnerKind>(i), gThreads, gSchedule, gPlacement);
+      if (auto pool = dynamic_cast<TaskRunnerPool*>(runner)) {
+        fprintf(stderr, "[%s] placement:\n", runner_name);
+        pool->DumpPlacement(stderr);
+      }
+      delete runner;
+    }
+  }
+
+  ChromeTraceWriter trace;
+  if (!gTracePath.empty() && !trace.Open(gTracePath.c_str())) {
+    fprintf(stderr, "Error: Could not open trace file %s\n", gTracePath.c_str());
+    return 1;
+  }
+
   for (auto& test : kTestFunctions) {
     // Run just the specified test
     if (!test_name.empty() && test_name != test.second) {
@@ -114,9 +173,18 @@ int main(int argc, char** argv) {
       }
 
       double min_time = std::numeric_limits<double>::max();
+      double min_cpu_time = 0.;  // CPU time for the run with the minimum wall time
+      RunnerStats min_stats;
+      std::vector<TraceEvent> min_trace;
       for (int j = 0; j < kRuns; j++) {
         // Create a new task system
-        TaskRunner* runner = TaskRunnerFactory(static_cast<TaskRunnerKind>(i), gThreads);
+        TaskRunner* runner = TaskRunnerFactory(static_cast<TaskRunnerKind>(i), gThreads, gSchedule,
+                                                gPlacement);
+        if (gStats) runner->EnableStats(true);
+        if (!gTracePath.empty()) runner->EnableTrace(true);
+        if (gElasticMin > 0) {
+          if (auto pool = dynamic_cast<TaskRunnerPool*>(runner)) pool->SetElastic(gElasticMin);
+        }
 
         // Run test
         TestResult result = test.first(*runner);
@@ -130,13 +198,28 @@ int main(int argc, char** argv) {
           exit(1);  // Exit with non-zero code on error
         }
 
-        min_time = std::min(min_time, result.exec_time_);
+        if (result.exec_time_ < min_time) {
+          min_time = result.exec_time_;
+          min_cpu_time = result.cpu_time_;
+          if (gStats) min_stats = runner->Stats();
+          if (!gTracePath.empty()) min_trace = runner->Trace();
+        }
 
         // Clean up task runner
         delete runner;
       }
-      printf("[%s]:\t\t%.3f ms\n", runner_name, min_time * 1000);
+      printf("[%s]:\t\t%.3f ms\t%.3f ms cpu\n", runner_name, min_time * 1000,
+             min_cpu_time * 1000);
+      if (gStats) PrintStats(min_stats);
+      if (!gTracePath.empty()) {
+        trace.AddProcess(std::string(test.second) + " [" + runner_name + "]", min_trace);
+      }
       fflush(NULL); // Try to flush any pending print operations
     }
   }
+
+  if (!trace.Close()) {
+    fprintf(stderr, "Error: Could not write trace file %s\n", gTracePath.c_str());
+    return 1;
+  }
 }
\ No newline at end of file
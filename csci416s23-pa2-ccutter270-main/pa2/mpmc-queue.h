@@ -0,0 +1,114 @@
+/**
+ * @file mpmc-queue.h
+ *
+ * Bounded lock-free multi-producer multi-consumer queue, following Dmitry Vyukov's array-based
+ * design with a sequence number in each cell.
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Fixed-capacity queue that any number of threads can push to and pop from concurrently
+ *
+ * Each cell carries a sequence number that tells producers and consumers whether the cell is
+ * ready for them in the current "lap" around the ring, so an operation only contends on the
+ * shared position it advances. The positions and cells are padded to separate cache lines to
+ * avoid false sharing between producers and consumers. Items must be copy-assignable.
+ */
+template <typename T>
+class MpmcQueue {
+ public:
+  /**
+   * @param capacity Maximum number of queued items, rounded up to a power of two
+   */
+  explicit MpmcQueue(size_t capacity = 1024) : enqueue_pos_(0), dequeue_pos_(0) {
+    size_t pow2 = 2;
+    while (pow2 < capacity) pow2 <<= 1;
+    mask_ = pow2 - 1;
+    cells_.reset(new Cell[pow2]);
+    for (size_t i = 0; i < pow2; i++) cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  MpmcQueue(const MpmcQueue&) = delete;
+  MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+  size_t Capacity() const { return mask_ + 1; }
+
+  /**
+   * @brief Add item at the tail of the queue
+   * @return false if the queue was full
+   */
+  bool TryPush(const T& item) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        // Cell is free in this lap, try to claim it
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        // Cell still holds an item from the previous lap
+        return false;
+      } else {
+        // Another producer claimed the cell first
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->item = item;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Remove item from the head of the queue
+   * @return false if the queue was empty
+   */
+  bool TryPop(T* item) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        // Cell holds an item in this lap, try to claim it
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        // Cell hasn't been filled yet
+        return false;
+      } else {
+        // Another consumer claimed the cell first
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    *item = cell->item;
+    // Free the cell for the producer in the next lap
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Approximate number of items in the queue, for deciding whether to wait
+   */
+  size_t SizeApprox() const {
+    size_t enqueued = enqueue_pos_.load(std::memory_order_acquire);
+    size_t dequeued = dequeue_pos_.load(std::memory_order_acquire);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+  }
+
+ private:
+  struct alignas(64) Cell {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) std::atomic<size_t> dequeue_pos_;
+  alignas(64) size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+};
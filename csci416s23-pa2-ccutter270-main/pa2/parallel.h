@@ -0,0 +1,130 @@
+/**
+ * @file parallel.h
+ *
+ * Loop templates layered on TaskRunner. The loop body is invoked directly from a single Runnable
+ * (allocated on the caller's stack) so it can be inlined, replacing a virtual RunTask call per
+ * iteration with one per block of iterations.
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "tasksys.h"
+
+/**
+ * @brief Half-open range of loop indices, processed in blocks of at least grain iterations
+ */
+struct BlockedRange {
+  BlockedRange(int begin, int end, int grain = 1)
+      : begin(begin), end(end), grain(std::max(grain, 1)) {}
+
+  int Size() const { return std::max(end - begin, 0); }
+  int NumBlocks() const { return Size() / grain + (Size() % grain != 0); }
+
+  int begin;
+  int end;
+  int grain;
+};
+
+/**
+ * @brief Value padded to a cache line so neighboring values are never falsely shared
+ */
+template <typename T>
+struct alignas(64) CacheAligned {
+  T value;
+};
+
+template <typename Body>
+class ParallelForRunnable final : public Runnable {
+ public:
+  ParallelForRunnable(const BlockedRange& range, const Body& body) : range_(range), body_(body) {}
+
+  void RunTask(int task_id, int num_tasks) override {
+    // In 64 bits, since the last block may extend past INT_MAX
+    int64_t start = range_.begin + static_cast<int64_t>(task_id) * range_.grain;
+    int stop = static_cast<int>(std::min<int64_t>(start + range_.grain, range_.end));
+    for (int i = static_cast<int>(start); i < stop; i++) body_(i);
+  }
+
+ private:
+  BlockedRange range_;
+  const Body& body_;
+};
+
+template <typename T, typename Map, typename Combine>
+class ParallelReduceRunnable final : public Runnable {
+ public:
+  ParallelReduceRunnable(const BlockedRange& range, const T& identity, const Map& map,
+                         const Combine& combine, CacheAligned<T>* partials)
+      : range_(range), identity_(identity), map_(map), combine_(combine), partials_(partials) {}
+
+  void RunTask(int task_id, int num_tasks) override {
+    // Each task reduces a contiguous set of blocks into its own partial. The split is computed in
+    // 64 bits, since num_blocks * num_tasks can exceed INT_MAX.
+    const int64_t num_blocks = range_.NumBlocks();
+    int64_t first_block = num_blocks * task_id / num_tasks;
+    int64_t last_block = num_blocks * (task_id + 1) / num_tasks;
+    int start = static_cast<int>(range_.begin + first_block * range_.grain);
+    int stop = static_cast<int>(
+        std::min<int64_t>(range_.begin + last_block * range_.grain, range_.end));
+    T accum = identity_;
+    for (int i = start; i < stop; i++) accum = combine_(accum, map_(i));
+    partials_[task_id].value = accum;
+  }
+
+ private:
+  BlockedRange range_;
+  const T& identity_;
+  const Map& map_;
+  const Combine& combine_;
+  CacheAligned<T>* partials_;
+};
+
+/**
+ * @brief Execute body(i) for every i in [begin, end)
+ *
+ * @param runner Runner used to execute the loop
+ * @param begin First index (inclusive)
+ * @param end Last index (exclusive)
+ * @param grain Number of consecutive iterations executed by each task
+ * @param body Loop body invoked with each index
+ */
+template <typename Body>
+void ParallelFor(TaskRunner& runner, int begin, int end, int grain, const Body& body) {
+  BlockedRange range(begin, end, grain);
+  if (range.Size() == 0) return;
+  ParallelForRunnable<Body> runnable(range, body);
+  runner.Run(&runnable, range.NumBlocks());
+}
+
+/**
+ * @brief Compute combine(...combine(combine(identity, map(begin)), map(begin + 1))..., map(end - 1))
+ *
+ * The range is split into a few tasks per runner thread. Each task accumulates into its own
+ * cache-line-padded partial, and the partials are combined in task order on the calling thread.
+ * combine must be associative.
+ *
+ * @param runner Runner used to execute the loop
+ * @param range Indices to reduce over
+ * @param identity Identity value for combine
+ * @param map Function invoked with each index to produce the value to reduce
+ * @param combine Binary reduction operator
+ * @return T Reduced value
+ */
+template <typename T, typename Map, typename Combine>
+T ParallelReduce(TaskRunner& runner, const BlockedRange& range, const T& identity, const Map& map,
+                 const Combine& combine) {
+  // Multiple tasks per thread give dynamically scheduled runners room to balance the load
+  const int kTasksPerThread = 4;
+
+  int num_tasks = std::min(range.NumBlocks(), kTasksPerThread * runner.NumThreads());
+  if (num_tasks == 0) return identity;
+
+  std::vector<CacheAligned<T>> partials(num_tasks);
+  ParallelReduceRunnable<T, Map, Combine> runnable(range, identity, map, combine, partials.data());
+  runner.Run(&runnable, num_tasks);
+
+  T result = identity;
+  for (auto& partial : partials) result = combine(result, partial.value);
+  return result;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file queue-bench.cc
+ *
+ * Throughput benchmark for the lock-free MPMC queue compared to a mutex-protected deque
+ */
+#include <getopt.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "CycleTimer.h"
+#include "mpmc-queue.h"
+
+const int kRuns = 3;
+int gProducers = 2;
+int gConsumers = 2;
+int gItems = 1000000;
+int gCapacity = 1024;
+
+// Specify expected options and usage
+const char* kShortOptions = "p:c:n:q:h";
+const struct option kLongOptions[] = {{"producers", required_argument, nullptr, 'p'},
+                                      {"consumers", required_argument, nullptr, 'c'},
+                                      {"items", required_argument, nullptr, 'n'},
+                                      {"capacity", required_argument, nullptr, 'q'},
+                                      {"help", no_argument, nullptr, 'h'},
+                                      {nullptr, 0, nullptr, 0}};
+
+void PrintUsage(const char* program_name) {
+  printf("Usage: %s [options]\n", program_name);
+  printf("Options:\n");
+  printf("  -p --producers <INT>  Number of producer threads, default: %d\n", gProducers);
+  printf("  -c --consumers <INT>  Number of consumer threads, default: %d\n", gConsumers);
+  printf("  -n --items <INT>      Items pushed by each producer, default: %d\n", gItems);
+  printf("  -q --capacity <INT>   Queue capacity, default: %d\n", gCapacity);
+  printf("  -h --help             Print this message\n");
+}
+
+/**
+ * @brief Bounded queue protected by a single lock, as a baseline
+ */
+template <typename T>
+class LockedQueue {
+ public:
+  explicit LockedQueue(size_t capacity) : capacity_(capacity) {}
+
+  bool TryPush(const T& item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (items_.size() >= capacity_) return false;
+    items_.push_back(item);
+    return true;
+  }
+
+  bool TryPop(T* item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (items_.empty()) return false;
+    *item = items_.front();
+    items_.pop_front();
+    return true;
+  }
+
+ private:
+  size_t capacity_;
+  std::mutex mutex_;
+  std::deque<T> items_;
+};
+
+/**
+ * @brief Push gItems items from each producer and pop them all with the consumers
+ * @return Elapsed time in seconds, or a negative value if items were lost or duplicated
+ */
+template <typename Queue>
+double RunBenchmark() {
+  Queue queue(gCapacity);
+  const int64_t total = static_cast<int64_t>(gProducers) * gItems;
+  std::atomic<int64_t> num_popped(0);
+  std::atomic<int64_t> sum(0);
+
+  double start_time = CycleTimer::currentSeconds();
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < gProducers; p++) {
+    threads.emplace_back([&queue, p] {
+      for (int i = 0; i < gItems; i++) {
+        int64_t item = static_cast<int64_t>(p) * gItems + i;
+        while (!queue.TryPush(item)) std::this_thread::yield();
+      }
+    });
+  }
+  for (int c = 0; c < gConsumers; c++) {
+    threads.emplace_back([&] {
+      int64_t local_sum = 0;
+      int64_t item;
+      while (num_popped.load(std::memory_order_relaxed) < total) {
+        if (queue.TryPop(&item)) {
+          local_sum += item;
+          num_popped.fetch_add(1, std::memory_order_relaxed);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      sum.fetch_add(local_sum, std::memory_order_relaxed);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  double end_time = CycleTimer::currentSeconds();
+
+  // Every item in 0..total-1 should be popped exactly once
+  if (sum.load() != total * (total - 1) / 2) return -1.;
+  return end_time - start_time;
+}
+
+template <typename Queue>
+bool Report(const char* name) {
+  double min_time = -1.;
+  for (int i = 0; i < kRuns; i++) {
+    double time = RunBenchmark<Queue>();
+    if (time < 0) {
+      printf("[%s]:\t\tIncorrect result\n", name);
+      return false;
+    }
+    if (min_time < 0 || time < min_time) min_time = time;
+  }
+  double total = static_cast<double>(gProducers) * gItems;
+  printf("[%s]:\t\t%.3f ms\t%.2f Mitems/s\n", name, min_time * 1000, total / min_time * 1e-6);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int opt;
+  while ((opt = getopt_long(argc, argv, kShortOptions, kLongOptions, nullptr)) != -1) {
+    switch (opt) {
+      case 'p':
+        gProducers = atoi(optarg);
+        break;
+      case 'c':
+        gConsumers = atoi(optarg);
+        break;
+      case 'n':
+        gItems = atoi(optarg);
+        break;
+      case 'q':
+        gCapacity = atoi(optarg);
+        break;
+      case 'h':
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+  if (gProducers < 1 || gConsumers < 1 || gItems < 1 || gCapacity < 1) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  printf("Queue throughput [%d producers, %d consumers, %d items per producer, capacity %d]\n",
+         gProducers, gConsumers, gItems, gCapacity);
+  bool correct = Report<MpmcQueue<int64_t>>("MpmcQueue");
+  correct = Report<LockedQueue<int64_t>>("LockedQueue") && correct;
+  return correct ? 0 : 1;
+}
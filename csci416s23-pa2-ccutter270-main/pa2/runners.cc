@@ -0,0 +1,89 @@
+#include "runners.h"
+#include <cassert>
+#include <cstring>
+
+bool ParseSchedulePolicy(const char* name, SchedulePolicy* policy) {
+  if (strcmp(name, "dynamic") == 0) {
+    *policy = SchedulePolicy::kDynamic;
+  } else if (strcmp(name, "static") == 0) {
+    *policy = SchedulePolicy::kStatic;
+  } else if (strcmp(name, "guided") == 0) {
+    *policy = SchedulePolicy::kGuided;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParsePlacementPolicy(const char* name, PlacementPolicy* policy) {
+  if (strcmp(name, "none") == 0) {
+    *policy = PlacementPolicy::kNone;
+  } else if (strcmp(name, "cores") == 0) {
+    *policy = PlacementPolicy::kCores;
+  } else if (strcmp(name, "socket") == 0) {
+    *policy = PlacementPolicy::kSocket;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+TaskRunner* TaskRunnerFactory(TaskRunnerKind kind, int num_threads, SchedulePolicy policy,
+                              PlacementPolicy placement) {
+  switch (kind) {
+    case TaskRunnerKind::kSerial:
+      return new TaskRunnerSerial();
+    case TaskRunnerKind::kSpawn:
+      return new TaskRunnerSpawn(num_threads);
+    case TaskRunnerKind::kSpin:
+      return new TaskRunnerSpin(num_threads, policy, placement);
+    case TaskRunnerKind::kSleep:
+      return new TaskRunnerSleep(num_threads, policy, placement);
+    case TaskRunnerKind::kStealing:
+      return new TaskRunnerStealing(num_threads);
+    case TaskRunnerKind::kHybrid:
+      return new TaskRunnerHybrid(num_threads, policy, placement);
+    case TaskRunnerKind::kQueue:
+      return new TaskRunnerQueue(num_threads);
+    case TaskRunnerKind::kSticky:
+      return new TaskRunnerSticky(num_threads);
+    case TaskRunnerKind::kPartitioned:
+      return new TaskRunnerPartitioned(num_threads);
+    case TaskRunnerKind::kSplitting:
+      return new TaskRunnerSplitting(num_threads);
+    case TaskRunnerKind::kFiber:
+      return new TaskRunnerFiber(num_threads);
+    default:
+      return nullptr;
+  }
+}
+
+const char* TaskRunnerName(TaskRunnerKind kind) {
+  switch (kind) {
+    case TaskRunnerKind::kSerial:
+      return "TaskRunnerSerial";
+    case TaskRunnerKind::kSpawn:
+      return "TaskRunnerSpawn";
+    case TaskRunnerKind::kSpin:
+      return "TaskRunnerSpin";
+    case TaskRunnerKind::kSleep:
+      return "TaskRunnerSleep";
+    case TaskRunnerKind::kStealing:
+      return "TaskRunnerStealing";
+    case TaskRunnerKind::kHybrid:
+      return "TaskRunnerHybrid";
+    case TaskRunnerKind::kQueue:
+      return "TaskRunnerQueue";
+    case TaskRunnerKind::kSticky:
+      return "TaskRunnerSticky";
+    case TaskRunnerKind::kPartitioned:
+      return "TaskRunnerPartitioned";
+    case TaskRunnerKind::kSplitting:
+      return "TaskRunnerSplitting";
+    case TaskRunnerKind::kFiber:
+      return "TaskRunnerFiber";
+    default:
+      assert(false);
+      return "";
+  }
+}
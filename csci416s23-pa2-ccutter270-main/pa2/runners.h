@@ -0,0 +1,42 @@
+/**
+ * @file runners.h
+ *
+ * Construct the task runners by name, shared by the test driver and the benchmarks
+ */
+#pragma once
+#include "tasksys.h"
+
+enum class TaskRunnerKind : int {
+  kSerial = 0,
+  kSpawn,
+  kSpin,
+  kSleep,
+  kStealing,
+  kHybrid,
+  kQueue,
+  kSticky,
+  kPartitioned,
+  kSplitting,
+  kFiber,
+  kMaxKind,
+};
+
+/**
+ * @brief Parse a schedule policy name (dynamic, static, guided)
+ * @return false if the name is not recognized
+ */
+bool ParseSchedulePolicy(const char* name, SchedulePolicy* policy);
+
+/**
+ * @brief Parse a placement policy name (none, cores, socket)
+ * @return false if the name is not recognized
+ */
+bool ParsePlacementPolicy(const char* name, PlacementPolicy* policy);
+
+/**
+ * @brief Create a new task runner of the specified kind, to be deleted by the caller
+ */
+TaskRunner* TaskRunnerFactory(TaskRunnerKind kind, int num_threads, SchedulePolicy policy,
+                              PlacementPolicy placement);
+
+const char* TaskRunnerName(TaskRunnerKind kind);
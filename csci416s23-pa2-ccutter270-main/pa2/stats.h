@@ -0,0 +1,202 @@
+/**
+ * @file stats.h
+ *
+ * Opt-in scheduling statistics for the task runners
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Counters for a single worker (worker 0 is the thread that launches tasks)
+ */
+struct WorkerStats {
+  int64_t tasks = 0;    // Tasks executed
+  int64_t busy_ns = 0;  // Time spent executing tasks
+  int64_t idle_ns = 0;  // Time spent spinning or sleeping while waiting for work
+  int64_t claims = 0;   // Chunks of tasks claimed from shared state
+  int64_t steals = 0;   // Tasks stolen from other workers
+  int64_t wakeups = 0;  // Times the worker stopped waiting for work
+};
+
+/**
+ * @brief Statistics collected since stats were enabled
+ */
+struct RunnerStats {
+  std::vector<WorkerStats> workers;
+  int64_t launches = 0;            // Launches whose first task was observed
+  int64_t first_task_ns = 0;       // Total time from a launch being ready to its first task
+  int64_t max_first_task_ns = 0;
+  int64_t returns = 0;             // Number of Run/Sync calls that waited for tasks
+  int64_t return_ns = 0;           // Total time from the last task finishing to Run/Sync returning
+  int64_t max_return_ns = 0;
+};
+
+/**
+ * @brief Collects RunnerStats from multiple threads
+ *
+ * All of the counters are relaxed atomics in per-worker cache lines. Runners check Enabled before
+ * reading the clock or touching the counters, so the overhead when disabled is a single load at
+ * each measurement point.
+ */
+class StatsRecorder {
+ public:
+  StatsRecorder() : enabled_(false), num_workers_(0) {}
+
+  static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Acquire so that a thread that sees stats enabled also sees the counters allocated by Enable
+  bool Enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Start collecting, discarding previously collected statistics, or stop collecting
+   * @param num_workers Number of workers that may record statistics
+   */
+  void Enable(bool enable, int num_workers) {
+    if (enable) {
+      // Workers may still be using the counters from a previous Enable so we only allocate once
+      if (!workers_) {
+        num_workers_ = std::max(num_workers, 1);
+        workers_.reset(new Counters[num_workers_]);
+      }
+      for (int i = 0; i < num_workers_; i++) workers_[i].Reset();
+      launch_.Reset();
+    }
+    enabled_.store(enable, std::memory_order_release);
+  }
+
+  void AddBusy(int worker, int tasks, int64_t ns) {
+    Counters& counters = Worker(worker);
+    counters.tasks.fetch_add(tasks, std::memory_order_relaxed);
+    counters.busy_ns.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  void AddIdle(int worker, int64_t ns) {
+    Counters& counters = Worker(worker);
+    counters.idle_ns.fetch_add(ns, std::memory_order_relaxed);
+    counters.wakeups.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void AddClaim(int worker) { Worker(worker).claims.fetch_add(1, std::memory_order_relaxed); }
+  void AddSteal(int worker) { Worker(worker).steals.fetch_add(1, std::memory_order_relaxed); }
+
+  /**
+   * @brief Record the start of the first task of a launch that became ready at ready_ns
+   */
+  void AddFirstTask(int64_t ready_ns) {
+    if (ready_ns == 0) return;  // Launched before stats were enabled
+    int64_t ns = NowNs() - ready_ns;
+    launch_.launches.fetch_add(1, std::memory_order_relaxed);
+    launch_.first_task_ns.fetch_add(ns, std::memory_order_relaxed);
+    UpdateMax(launch_.max_first_task_ns, ns);
+  }
+
+  /**
+   * @brief Record a Run/Sync returning after the last task it waited for finished at last_task_ns
+   */
+  void AddReturn(int64_t last_task_ns) {
+    if (last_task_ns == 0) return;
+    int64_t ns = NowNs() - last_task_ns;
+    launch_.returns.fetch_add(1, std::memory_order_relaxed);
+    launch_.return_ns.fetch_add(ns, std::memory_order_relaxed);
+    UpdateMax(launch_.max_return_ns, ns);
+  }
+
+  /**
+   * @brief Copy of the statistics, empty if stats were never enabled
+   */
+  RunnerStats Snapshot() const {
+    RunnerStats stats;
+    for (int i = 0; i < num_workers_; i++) {
+      const Counters& counters = workers_[i];
+      WorkerStats worker;
+      worker.tasks = counters.tasks.load(std::memory_order_relaxed);
+      worker.busy_ns = counters.busy_ns.load(std::memory_order_relaxed);
+      worker.idle_ns = counters.idle_ns.load(std::memory_order_relaxed);
+      worker.claims = counters.claims.load(std::memory_order_relaxed);
+      worker.steals = counters.steals.load(std::memory_order_relaxed);
+      worker.wakeups = counters.wakeups.load(std::memory_order_relaxed);
+      stats.workers.push_back(worker);
+    }
+    stats.launches = launch_.launches.load(std::memory_order_relaxed);
+    stats.first_task_ns = launch_.first_task_ns.load(std::memory_order_relaxed);
+    stats.max_first_task_ns = launch_.max_first_task_ns.load(std::memory_order_relaxed);
+    stats.returns = launch_.returns.load(std::memory_order_relaxed);
+    stats.return_ns = launch_.return_ns.load(std::memory_order_relaxed);
+    stats.max_return_ns = launch_.max_return_ns.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  /**
+   * @brief Atomically raise value to at least sample
+   */
+  static void UpdateMax(std::atomic<int64_t>& value, int64_t sample) {
+    int64_t current = value.load(std::memory_order_relaxed);
+    while (current < sample &&
+           !value.compare_exchange_weak(current, sample, std::memory_order_relaxed)) {
+    }
+  }
+
+ private:
+  struct alignas(64) Counters {
+    void Reset() {
+      for (auto* counter : {&tasks, &busy_ns, &idle_ns, &claims, &steals, &wakeups})
+        counter->store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<int64_t> tasks{0};
+    std::atomic<int64_t> busy_ns{0};
+    std::atomic<int64_t> idle_ns{0};
+    std::atomic<int64_t> claims{0};
+    std::atomic<int64_t> steals{0};
+    std::atomic<int64_t> wakeups{0};
+  };
+
+  struct alignas(64) LaunchCounters {
+    void Reset() {
+      for (auto* counter : {&launches, &first_task_ns, &max_first_task_ns, &returns, &return_ns,
+                            &max_return_ns})
+        counter->store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<int64_t> launches{0};
+    std::atomic<int64_t> first_task_ns{0};
+    std::atomic<int64_t> max_first_task_ns{0};
+    std::atomic<int64_t> returns{0};
+    std::atomic<int64_t> return_ns{0};
+    std::atomic<int64_t> max_return_ns{0};
+  };
+
+  // Workers beyond the allocated counters (e.g. additional launching threads) share the last slot
+  Counters& Worker(int worker) { return workers_[std::min(worker, num_workers_ - 1)]; }
+
+  std::atomic<bool> enabled_;
+  int num_workers_;
+  std::unique_ptr<Counters[]> workers_;
+  LaunchCounters launch_;
+};
+
+/**
+ * @brief Record the time until the end of the scope as idle time for worker, if stats are enabled
+ */
+class ScopedIdle {
+ public:
+  ScopedIdle(StatsRecorder& stats, int worker)
+      : stats_(stats), worker_(worker), start_ns_(stats.Enabled() ? StatsRecorder::NowNs() : 0) {}
+  ~ScopedIdle() {
+    if (start_ns_ != 0) stats_.AddIdle(worker_, StatsRecorder::NowNs() - start_ns_);
+  }
+
+ private:
+  StatsRecorder& stats_;
+  int worker_;
+  int64_t start_ns_;
+};
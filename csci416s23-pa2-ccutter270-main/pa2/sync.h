@@ -0,0 +1,165 @@
+/**
+ * @file sync.h
+ *
+ * Low-level synchronization primitives used by the task runners
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Hint to the processor that we are in a spin-wait loop
+ */
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#else
+  std::this_thread::yield();
+#endif
+}
+
+/**
+ * @brief Block while *addr == expected, until woken by FutexWakeAll (may wake spuriously)
+ */
+inline void FutexWait(std::atomic<uint32_t>* addr, uint32_t expected) {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr,
+          nullptr, 0);
+#else
+  // Without futexes we fall back to polling
+  if (addr->load(std::memory_order_acquire) == expected) std::this_thread::yield();
+#endif
+}
+
+inline void FutexWakeAll(std::atomic<uint32_t>* addr) {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr,
+          nullptr, 0);
+#endif
+}
+
+/**
+ * @brief Lets threads sleep until some condition (maintained by the caller) may have changed
+ *
+ * A waiter calls PrepareWait, re-checks its condition, and then either calls CancelWait (if the
+ * condition is satisfied) or Wait with the returned key. Wait returns immediately if there was a
+ * NotifyAll after PrepareWait, so notifications can't be lost. NotifyAll is just an atomic
+ * increment when there are no waiters.
+ */
+class EventCount {
+ public:
+  EventCount() : epoch_(0), num_waiters_(0) {}
+
+  uint32_t PrepareWait() {
+    num_waiters_.fetch_add(1, std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_seq_cst);
+  }
+
+  void CancelWait() { num_waiters_.fetch_sub(1, std::memory_order_relaxed); }
+
+  void Wait(uint32_t key) {
+    FutexWait(&epoch_, key);
+    num_waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void NotifyAll() {
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    if (num_waiters_.load(std::memory_order_seq_cst) > 0) FutexWakeAll(&epoch_);
+  }
+
+ private:
+  std::atomic<uint32_t> epoch_;
+  std::atomic<int> num_waiters_;
+};
+
+/**
+ * @brief Sense-reversing barrier for a fixed set of threads
+ *
+ * The last thread to arrive resets the count and flips the global sense, releasing the threads
+ * spinning on it. Each thread reads the sense on arrival, which can't change until it arrives, so
+ * no per-thread state is needed. Waiting threads yield after a short spin so that the barrier
+ * also works when there are more threads than cores.
+ */
+class SenseBarrier {
+ public:
+  explicit SenseBarrier(int num_threads)
+      : num_threads_(num_threads), count_(num_threads), sense_(false) {}
+
+  void Wait() {
+    const int kSpins = 1024;
+    bool sense = !sense_.load(std::memory_order_acquire);
+    if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      count_.store(num_threads_, std::memory_order_relaxed);
+      sense_.store(sense, std::memory_order_release);
+      return;
+    }
+    for (int i = 0; sense_.load(std::memory_order_acquire) != sense; i++) {
+      if (i < kSpins) {
+        CpuRelax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+ private:
+  const int num_threads_;
+  alignas(64) std::atomic<int> count_;
+  alignas(64) std::atomic<bool> sense_;
+};
+
+/**
+ * @brief Spin for a bounded, self-tuning interval and then park on an EventCount
+ *
+ * The spin limit doubles whenever the condition becomes true while spinning (work is arriving in
+ * quick bursts) and halves whenever we give up and park (we are wasting the CPU). Runners keep one
+ * per worker so the tuning doesn't carry over between runners. Several caller threads may share a
+ * waiter, in which case the limit is simply a shared estimate.
+ */
+class SpinThenPark {
+ public:
+  static constexpr int kMinSpins = 16;
+  static constexpr int kMaxSpins = 16 * 1024;
+
+  SpinThenPark() : spin_limit_(1024) {}
+
+  /**
+   * @brief Return once ready() is true
+   * @return true if we had to park
+   */
+  template <typename Ready>
+  bool Wait(EventCount& event, Ready ready) {
+    const int spin_limit = spin_limit_.load(std::memory_order_relaxed);
+    for (int i = 0; i < spin_limit; i++) {
+      if (ready()) {
+        spin_limit_.store(std::min(spin_limit * 2, kMaxSpins), std::memory_order_relaxed);
+        return false;
+      }
+      CpuRelax();
+    }
+    spin_limit_.store(std::max(spin_limit / 2, kMinSpins), std::memory_order_relaxed);
+
+    while (true) {
+      uint32_t key = event.PrepareWait();
+      if (ready()) {
+        event.CancelWait();
+        return true;
+      }
+      event.Wait(key);
+      if (ready()) return true;
+    }
+  }
+
+ private:
+  std::atomic<int> spin_limit_;
+};
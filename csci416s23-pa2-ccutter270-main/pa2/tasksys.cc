@@ -1,12 +1,88 @@
 #include "tasksys.h"
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <thread>
 
-void TaskRunnerSerial::Run(Runnable* runnable, int num_tasks) {
-  for (int i = 0; i < num_tasks; i++) {
-    runnable->RunTask(i, num_tasks);
+namespace {
+
+// Runner whose task the current thread is executing and the thread's worker index in that runner,
+// used to detect launches from within tasks
+thread_local const TaskRunner* current_runner = nullptr;
+thread_local int current_worker = 0;
+
+/**
+ * @brief Mark the current thread as executing tasks of runner until the end of the scope
+ */
+class ScopedCurrentRunner {
+ public:
+  ScopedCurrentRunner(const TaskRunner* runner, int worker)
+      : prev_runner_(current_runner), prev_worker_(current_worker) {
+    current_runner = runner;
+    current_worker = worker;
   }
+  ~ScopedCurrentRunner() {
+    current_runner = prev_runner_;
+    current_worker = prev_worker_;
+  }
+
+ private:
+  const TaskRunner* prev_runner_;
+  int prev_worker_;
+};
+
+// Arena for tasks executed by the current thread, set while running a fiber with its own arena
+thread_local ScratchArena* current_arena = nullptr;
+
+ScratchArena& CurrentArena() {
+  thread_local ScratchArena thread_arena;
+  return current_arena != nullptr ? *current_arena : thread_arena;
+}
+
+/**
+ * @brief Execute tasks [begin, end) of runnable as worker, releasing their scratch memory after
+ */
+void RunRangeWithContext(Runnable* runnable, int begin, int end, int num_tasks, int worker) {
+  ScratchArena& arena = CurrentArena();
+  ScratchArena::Marker marker = arena.Mark();
+  TaskContext context{worker, arena};
+  runnable->RunRange(begin, end, num_tasks, context);
+  arena.Release(marker);
+}
+
+}  // namespace
+
+void ContextRunnable::RunTask(int task_id, int task_count) {
+  RunRangeWithContext(this, task_id, task_id + 1, task_count, current_worker);
+}
+
+void TaskRunner::RunTasks(Runnable* runnable, int begin, int end, int num_tasks, int worker,
+                          int launch) {
+  if (!tracer_.Enabled()) {
+    RunRangeWithContext(runnable, begin, end, num_tasks, worker);
+    return;
+  }
+  int64_t start_ns = StatsRecorder::NowNs();
+  RunRangeWithContext(runnable, begin, end, num_tasks, worker);
+  tracer_.AddTasks(worker, launch, begin, end, start_ns, StatsRecorder::NowNs());
+}
+
+TaskID TaskRunner::RunAsyncWithDeps(Runnable* runnable, int num_tasks,
+                                    const std::vector<TaskID>& deps) {
+  // All prior launches have completed by the time Run returns so the dependencies are satisfied
+  Run(runnable, num_tasks);
+  return next_task_id_++;
+}
+
+void TaskRunner::RunBatch(const std::vector<std::pair<Runnable*, int>>& launches) {
+  for (const auto& launch : launches) Run(launch.first, launch.second);
+}
+
+void TaskRunnerSerial::Run(Runnable* runnable, int num_tasks) {
+  int64_t start_ns = stats_.Enabled() ? StatsRecorder::NowNs() : 0;
+  RunTasks(runnable, 0, num_tasks, num_tasks, 0, tracer_.NewLaunch());
+  if (start_ns != 0) stats_.AddBusy(0, num_tasks, StatsRecorder::NowNs() - start_ns);
 }
 
 
@@ -18,27 +94,1043 @@ void TaskRunnerSpawn::Run(Runnable* runnable, int num_tasks) {
 }
 
 
-void TaskRunnerSpin::Run(Runnable* runnable, int num_tasks) {
-  // TODO: Replace this placeholder implementation (used to ensure skeleton is runnable) with your
-  // code
-  TaskRunnerSerial serial;
-  serial.Run(runnable, num_tasks);
+int TaskChunker::ChunkSize(int remaining, int num_tasks, int64_t task_ns) const {
+  int chunk = 1;
+  switch (policy_) {
+    case SchedulePolicy::kDynamic:
+      chunk = 1;
+      break;
+    case SchedulePolicy::kStatic:
+      chunk = (num_tasks + num_workers_ - 1) / num_workers_;
+      break;
+    case SchedulePolicy::kGuided: {
+      // Leave enough chunks for every worker to get a couple toward the tail
+      const int kChunksPerWorker = 2;
+      // Chunks should take at least this long so that dispatch is a small fraction of the time
+      const int64_t kTargetChunkNs = 20000;
+
+      chunk = remaining / (kChunksPerWorker * num_workers_);
+      if (task_ns > 0) {
+        chunk = static_cast<int>(std::max<int64_t>(chunk, kTargetChunkNs / task_ns));
+      }
+      // Leave every worker a share, however cheap the tasks measured so far were
+      chunk = std::min(chunk, (remaining + num_workers_ - 1) / num_workers_);
+      break;
+    }
+  }
+  return std::max(1, std::min(chunk, remaining));
 }
 
-TaskRunnerSpin::TaskRunnerSpin(int num_threads) : num_threads_(num_threads) {}
+int64_t TaskChunker::Record(int64_t task_ns, int count, int64_t elapsed_ns) {
+  int64_t sample = std::max<int64_t>(elapsed_ns / count, 1);
+  return task_ns == 0 ? sample : (3 * task_ns + sample) / 4;
+}
 
-TaskRunnerSpin::~TaskRunnerSpin() {}
 
+TaskRunnerPool::TaskRunnerPool(int num_threads, WaitMode mode, SchedulePolicy policy,
+                               PlacementPolicy placement)
+    : num_threads_(std::max(num_threads, 1)),
+      mode_(mode),
+      chunker_(policy, num_threads_),
+      waiters_(num_threads_),
+      num_ready_(0),
+      num_incomplete_(0),
+      num_completed_(0),
+      num_launch_waiters_(0),
+      exit_(false),
+      last_complete_ns_(0),
+      elastic_(false),
+      min_threads_(num_threads_),
+      num_active_(num_threads_),
+      num_unclaimed_(0),
+      high_since_ns_(0),
+      last_resize_ns_(0),
+      idle_since_ns_(num_threads_, StatsRecorder::NowNs()) {
+  if (placement != PlacementPolicy::kNone) {
+    topology_ = CpuTopology::Discover();
+    placement_ = topology_.Placement(num_threads_, placement);
+  }
+  if (placement_.empty()) placement_.assign(num_threads_, -1);
+  // We don't pin the caller's thread, which would outlive the runner
+  placement_[0] = -1;
 
+  // The thread waiting in Run or Sync also executes tasks
+  for (int i = 1; i < num_threads_; i++) {
+    threads_.emplace_back(&TaskRunnerPool::WorkerLoop, this, i);
+    if (placement_[i] >= 0 && !PinThread(threads_.back(), placement_[i])) placement_[i] = -1;
+  }
+}
 
-void TaskRunnerSleep::Run(Runnable* runnable, int num_tasks) {
-  // TODO: Replace this placeholder implementation (used to ensure skeleton is runnable) with your
-  // code
-  TaskRunnerSerial serial;
-  serial.Run(runnable, num_tasks);
+TaskRunnerPool::~TaskRunnerPool() {
+  Sync();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+  }
+  work_cv_.notify_all();
+  park_cv_.notify_all();
+  event_.NotifyAll();
+  for (auto& thread : threads_) thread.join();
+}
+
+void TaskRunnerPool::SetElastic(int min_threads) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  min_threads_ = std::min(std::max(min_threads, 1), num_threads_);
+  elastic_.store(min_threads_ < num_threads_, std::memory_order_relaxed);
+  if (min_threads_ == num_threads_) {
+    num_active_.store(num_threads_, std::memory_order_relaxed);
+    park_cv_.notify_all();
+  }
+}
+
+void TaskRunnerPool::DumpPlacement(FILE* file) const {
+  ::DumpPlacement(file, topology_, placement_);
+}
+
+void TaskRunnerPool::Run(Runnable* runnable, int num_tasks) {
+  if (current_runner == this) {
+    // The calling task belongs to a launch that can't complete until we return, so we can only
+    // wait for the tasks launched here
+    WaitForLaunch(RunAsyncWithDeps(runnable, num_tasks, {}), current_worker, true);
+    return;
+  }
+  RunAsyncWithDeps(runnable, num_tasks, {});
+  Sync();
+}
+
+void TaskRunnerPool::Run(Runnable* runnable, int num_tasks, TaskPriority priority) {
+  TaskID id = RunAsyncWithDeps(runnable, num_tasks, {}, priority);
+  if (current_runner == this) {
+    WaitForLaunch(id, current_worker, true);
+  } else {
+    WaitForLaunch(id, 0, false);
+  }
+}
+
+void TaskRunnerPool::RunBatch(const std::vector<std::pair<Runnable*, int>>& launches) {
+  if (current_runner == this) {
+    // Nested launches can't wait with Sync
+    TaskRunner::RunBatch(launches);
+    return;
+  }
+  std::vector<TaskID> deps;
+  for (const auto& launch : launches) {
+    deps.assign(1, RunAsyncWithDeps(launch.first, launch.second, deps));
+  }
+  Sync();
+}
+
+void TaskRunnerPool::WaitForLaunch(TaskID id, int worker, bool help) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  num_launch_waiters_++;
+  while (true) {
+    auto found = incomplete_.find(id);
+    if (found == incomplete_.end()) break;
+    const Launch& launch = *found->second;
+    bool own_tasks = launch.num_pending_deps == 0 && launch.next_task < launch.num_tasks;
+    if ((help || own_tasks) && RunChunkLocked(lock, worker, id)) continue;
+
+    // All of our tasks are claimed by other threads, wait for any launch to complete (or, if we
+    // can help, for more work)
+    ScopedIdle idle(stats_, worker);
+    if (mode_ == WaitMode::kSleep) {
+      done_cv_.wait(lock, [&] {
+        return incomplete_.count(id) == 0 ||
+               (help && num_ready_.load(std::memory_order_relaxed) > 0);
+      });
+      continue;
+    }
+    uint64_t seen = num_completed_.load(std::memory_order_relaxed);
+    auto ready = [&] {
+      return num_completed_.load(std::memory_order_acquire) != seen ||
+             (help && num_ready_.load(std::memory_order_acquire) > 0);
+    };
+    lock.unlock();
+    if (mode_ == WaitMode::kHybrid) {
+      waiters_[worker].Wait(event_, ready);
+    } else {
+      while (!ready()) std::this_thread::yield();
+    }
+    lock.lock();
+  }
+  num_launch_waiters_--;
+}
+
+TaskID TaskRunnerPool::RunAsyncWithDeps(Runnable* runnable, int num_tasks,
+                                        const std::vector<TaskID>& deps) {
+  return RunAsyncWithDeps(runnable, num_tasks, deps, TaskPriority::kNormal);
+}
+
+TaskID TaskRunnerPool::RunAsyncWithDeps(Runnable* runnable, int num_tasks,
+                                        const std::vector<TaskID>& deps, TaskPriority priority) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Launch* launch = new Launch{
+      next_task_id_++, runnable, std::max(num_tasks, 0), 0, 0, 0, {}, 0, priority, 0};
+  incomplete_.emplace(launch->id, std::unique_ptr<Launch>(launch));
+  num_incomplete_.store(incomplete_.size(), std::memory_order_release);
+
+  // Dependencies that are no longer in the incomplete set have already finished
+  for (TaskID dep : deps) {
+    auto found = incomplete_.find(dep);
+    if (found != incomplete_.end() && found->second.get() != launch) {
+      found->second->dependents.push_back(launch);
+      launch->num_pending_deps++;
+    }
+  }
+
+  TaskID id = launch->id;
+  if (launch->num_pending_deps == 0) MakeReadyLocked(launch);
+  return id;
+}
+
+void TaskRunnerPool::Sync() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!incomplete_.empty()) {
+    // Help out with any available tasks instead of just waiting
+    if (RunChunkLocked(lock, 0)) continue;
+
+    ScopedIdle idle(stats_, 0);
+    if (mode_ == WaitMode::kSleep) {
+      done_cv_.wait(lock, [this] {
+        return incomplete_.empty() || num_ready_.load(std::memory_order_relaxed) > 0;
+      });
+    } else if (mode_ == WaitMode::kHybrid) {
+      lock.unlock();
+      // Keep the spin tuning for callers across launches
+      waiters_[0].Wait(event_, [this] {
+        return num_incomplete_.load(std::memory_order_acquire) == 0 ||
+               num_ready_.load(std::memory_order_acquire) > 0;
+      });
+      lock.lock();
+    } else {
+      lock.unlock();
+      while (num_incomplete_.load(std::memory_order_acquire) > 0 &&
+             num_ready_.load(std::memory_order_acquire) == 0) {
+        std::this_thread::yield();
+      }
+      lock.lock();
+    }
+  }
+  if (stats_.Enabled()) {
+    stats_.AddReturn(last_complete_ns_);
+    last_complete_ns_ = 0;
+  }
+}
+
+void TaskRunnerPool::WorkerLoop(int worker) {
+  if (mode_ == WaitMode::kSleep) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (!exit_ && num_ready_.load(std::memory_order_relaxed) == 0) {
+        ScopedIdle idle(stats_, worker);
+        work_cv_.wait(lock,
+                      [this] { return exit_ || num_ready_.load(std::memory_order_relaxed) > 0; });
+      }
+      if (exit_) return;
+      if (ParkIfInactiveLocked(lock, worker)) continue;
+      RunChunkLocked(lock, worker);
+    }
+  } else if (mode_ == WaitMode::kHybrid) {
+    SpinThenPark& waiter = waiters_[worker];
+    while (!exit_.load(std::memory_order_acquire)) {
+      if (num_ready_.load(std::memory_order_acquire) == 0) {
+        ScopedIdle idle(stats_, worker);
+        waiter.Wait(event_, [this] {
+          return num_ready_.load(std::memory_order_acquire) > 0 ||
+                 exit_.load(std::memory_order_acquire);
+        });
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (ParkIfInactiveLocked(lock, worker)) continue;
+      RunChunkLocked(lock, worker);
+    }
+  } else {
+    while (!exit_.load(std::memory_order_acquire)) {
+      // Only acquire the lock once there is something to do. We yield instead of just spinning so
+      // that oversubscribed threads don't starve the threads doing useful work.
+      if (num_ready_.load(std::memory_order_acquire) == 0) {
+        ScopedIdle idle(stats_, worker);
+        // Spinning workers are never woken, so elastic pools stop periodically to check whether
+        // it is time to park
+        int64_t deadline_ns = 0;
+        if (elastic_.load(std::memory_order_relaxed)) {
+          deadline_ns = StatsRecorder::NowNs() + kParkAfterIdleNs;
+        }
+        while (num_ready_.load(std::memory_order_acquire) == 0 &&
+               !exit_.load(std::memory_order_acquire) &&
+               (deadline_ns == 0 || StatsRecorder::NowNs() < deadline_ns)) {
+          std::this_thread::yield();
+        }
+        if (num_ready_.load(std::memory_order_acquire) == 0) {
+          if (deadline_ns != 0) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ResizeLocked(StatsRecorder::NowNs());
+            ParkIfInactiveLocked(lock, worker);
+          }
+          continue;
+        }
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (ParkIfInactiveLocked(lock, worker)) continue;
+      RunChunkLocked(lock, worker);
+    }
+  }
+}
+
+bool TaskRunnerPool::RunChunkLocked(std::unique_lock<std::mutex>& lock, int worker,
+                                    TaskID preferred) {
+  // Ready launches of the highest priority that has any
+  std::deque<Launch*>* lane = nullptr;
+  for (auto& ready : ready_) {
+    if (!ready.empty()) {
+      lane = &ready;
+      break;
+    }
+  }
+
+  Launch* launch = nullptr;
+  if (preferred >= 0) {
+    // Nested launches work on their own tasks and then on the most recent launch, which keeps the
+    // stack of nested tasks shallow
+    auto found = incomplete_.find(preferred);
+    if (found != incomplete_.end() && found->second->num_pending_deps == 0 &&
+        found->second->next_task < found->second->num_tasks) {
+      launch = found->second.get();
+    } else if (lane != nullptr) {
+      launch = lane->back();
+    }
+  } else if (lane != nullptr) {
+    launch = lane->front();
+  }
+  if (launch == nullptr) return false;
+
+  int begin = launch->next_task;
+  int end = begin + (launch->priority == TaskPriority::kLow
+                         ? 1
+                         : chunker_.ChunkSize(launch->num_tasks - begin, launch->num_tasks,
+                                              launch->task_ns));
+  launch->next_task = end;
+  if (end == launch->num_tasks) {
+    std::deque<Launch*>& ready = ready_[static_cast<int>(launch->priority)];
+    if (launch == ready.front()) {
+      ready.pop_front();
+    } else {
+      ready.erase(std::find(ready.begin(), ready.end(), launch));
+    }
+    num_ready_.store(num_ready_.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+  }
+  num_unclaimed_ -= end - begin;
+
+  const bool elastic = elastic_.load(std::memory_order_relaxed);
+  if (elastic) {
+    idle_since_ns_[worker] = 0;
+    ResizeLocked(StatsRecorder::NowNs());
+  }
+
+  bool stats = stats_.Enabled();
+  if (stats) {
+    stats_.AddClaim(worker);
+    if (begin == 0) stats_.AddFirstTask(launch->ready_ns);
+  }
+
+  int64_t elapsed_ns = 0;
+  lock.unlock();
+  {
+    ScopedCurrentRunner current(this, worker);
+    if (chunker_.Timed() || stats) {
+      int64_t start_ns = StatsRecorder::NowNs();
+      RunTasks(launch->runnable, begin, end, launch->num_tasks, worker, launch->id);
+      elapsed_ns = StatsRecorder::NowNs() - start_ns;
+      if (stats) stats_.AddBusy(worker, end - begin, elapsed_ns);
+    } else {
+      RunTasks(launch->runnable, begin, end, launch->num_tasks, worker, launch->id);
+    }
+  }
+  lock.lock();
+
+  // Each launch keeps its own estimate, since its tasks may cost nothing like the last launch's
+  if (chunker_.Timed()) {
+    launch->task_ns = TaskChunker::Record(launch->task_ns, end - begin, elapsed_ns);
+  }
+
+  if (elastic) idle_since_ns_[worker] = StatsRecorder::NowNs();
+  launch->num_finished += end - begin;
+  if (launch->num_finished == launch->num_tasks) CompleteLocked(launch);
+  return true;
+}
+
+void TaskRunnerPool::MakeReadyLocked(Launch* launch) {
+  if (launch->num_tasks == 0) {
+    CompleteLocked(launch);
+    return;
+  }
+  if (stats_.Enabled()) launch->ready_ns = StatsRecorder::NowNs();
+  ready_[static_cast<int>(launch->priority)].push_back(launch);
+  num_ready_.store(num_ready_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  num_unclaimed_ += launch->num_tasks;
+  if (mode_ == WaitMode::kHybrid) {
+    event_.NotifyAll();
+  } else {
+    work_cv_.notify_all();
+    done_cv_.notify_all();
+  }
+}
+
+void TaskRunnerPool::ResizeLocked(int64_t now_ns) {
+  int num_active = num_active_.load(std::memory_order_relaxed);
+  if (num_unclaimed_ > kGrowTasksPerWorker * num_active) {
+    if (high_since_ns_ == 0) high_since_ns_ = now_ns;
+  } else {
+    high_since_ns_ = 0;
+  }
+
+  if (high_since_ns_ != 0 && now_ns - high_since_ns_ >= kGrowAfterNs &&
+      now_ns - last_resize_ns_ >= kGrowAfterNs && num_active < num_threads_) {
+    idle_since_ns_[num_active] = now_ns;
+    num_active_.store(num_active + 1, std::memory_order_relaxed);
+    high_since_ns_ = now_ns;  // The load has to stay high for another interval to grow again
+    last_resize_ns_ = now_ns;
+    park_cv_.notify_all();
+  } else if (high_since_ns_ == 0 && num_active > min_threads_ &&
+             idle_since_ns_[num_active - 1] != 0 &&
+             now_ns - idle_since_ns_[num_active - 1] >= kParkAfterIdleNs &&
+             now_ns - last_resize_ns_ >= kParkAfterIdleNs) {
+    // The worker parks the next time it looks for work
+    num_active_.store(num_active - 1, std::memory_order_relaxed);
+    last_resize_ns_ = now_ns;
+  }
+}
+
+bool TaskRunnerPool::ParkIfInactiveLocked(std::unique_lock<std::mutex>& lock, int worker) {
+  if (worker < num_active_.load(std::memory_order_relaxed)) return false;
+  ScopedIdle idle(stats_, worker);
+  park_cv_.wait(lock, [&] {
+    return exit_.load(std::memory_order_relaxed) ||
+           worker < num_active_.load(std::memory_order_relaxed);
+  });
+  return true;
+}
+
+void TaskRunnerPool::CompleteLocked(Launch* launch) {
+  for (Launch* dependent : launch->dependents) {
+    if (--dependent->num_pending_deps == 0) MakeReadyLocked(dependent);
+  }
+  incomplete_.erase(launch->id);  // Frees launch
+  num_incomplete_.store(incomplete_.size(), std::memory_order_release);
+  num_completed_.fetch_add(1, std::memory_order_release);
+  if (incomplete_.empty() && stats_.Enabled()) last_complete_ns_ = StatsRecorder::NowNs();
+  if (incomplete_.empty() || num_launch_waiters_ > 0) {
+    if (mode_ == WaitMode::kHybrid) {
+      event_.NotifyAll();
+    } else {
+      done_cv_.notify_all();
+    }
+  }
+}
+
+
+WorkerGroup::WorkerGroup(int num_workers)
+    : body_(nullptr), epoch_(0), num_running_(0), exit_(false) {
+  for (int i = 1; i < num_workers; i++) {
+    threads_.emplace_back(&WorkerGroup::WorkerLoop, this, i);
+  }
+}
+
+WorkerGroup::~WorkerGroup() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+void WorkerGroup::Run(const std::function<void(int)>& body) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    body_ = &body;
+    num_running_ = static_cast<int>(threads_.size());
+    epoch_++;
+  }
+  work_cv_.notify_all();
+
+  // The calling thread is worker 0
+  body(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return num_running_ == 0; });
+  body_ = nullptr;
+}
+
+void WorkerGroup::WorkerLoop(int worker) {
+  uint64_t seen_epoch = 0;
+  while (true) {
+    const std::function<void(int)>* body;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [&] { return exit_ || epoch_ != seen_epoch; });
+      if (exit_) return;
+      seen_epoch = epoch_;
+      body = body_;
+    }
+
+    (*body)(worker);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--num_running_ > 0) continue;
+    }
+    done_cv_.notify_one();
+  }
+}
+
+
+TaskRunnerStealing::TaskRunnerStealing(int num_threads, bool sticky)
+    : workers_(std::max(num_threads, 1)),
+      barrier_(workers_.NumWorkers()),
+      sticky_(sticky),
+      assignments_(sticky ? workers_.NumWorkers() : 0),
+      num_seeded_(0),
+      launch_ns_(0),
+      started_(false),
+      last_task_ns_(0) {
+  for (int i = 0; i < workers_.NumWorkers(); i++) {
+    deques_.emplace_back(new WorkStealingDeque<int>());
+  }
+}
+
+void TaskRunnerStealing::Run(Runnable* runnable, int num_tasks) {
+  if (num_tasks <= 0) return;
+  if (current_runner == this) {
+    // All of the workers are busy with the enclosing launch
+    RunTasks(runnable, 0, num_tasks, num_tasks, current_worker, tracer_.NewLaunch());
+    return;
+  }
+  std::lock_guard<std::mutex> lock(launch_mutex_);
+  StartLaunch();
+  const int num_workers = workers_.NumWorkers();
+  const int launch = tracer_.NewLaunch();
+  workers_.Run([&](int worker) { RunWorker(worker, runnable, num_tasks, num_workers, launch); });
+  if (launch_ns_ != 0) stats_.AddReturn(last_task_ns_.load(std::memory_order_relaxed));
+}
+
+void TaskRunnerStealing::RunBatch(const std::vector<std::pair<Runnable*, int>>& launches) {
+  if (current_runner == this) {
+    TaskRunner::RunBatch(launches);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(launch_mutex_);
+  StartLaunch();
+  const int num_workers = workers_.NumWorkers();
+  const int num_launches = static_cast<int>(launches.size());
+  const int first_launch = tracer_.NewLaunch(num_launches);
+  workers_.Run([&](int worker) {
+    for (int i = 0; i < num_launches; i++) {
+      // num_seeded_ keeps counting up across the launches
+      RunWorker(worker, launches[i].first, launches[i].second, num_workers * (i + 1),
+                first_launch < 0 ? -1 : first_launch + i);
+      // No worker may start seeding the next launch while others could still be stealing
+      if (i + 1 < num_launches) barrier_.Wait();
+    }
+  });
+  if (launch_ns_ != 0) stats_.AddReturn(last_task_ns_.load(std::memory_order_relaxed));
+}
+
+void TaskRunnerStealing::StartLaunch() {
+  num_seeded_.store(0, std::memory_order_relaxed);
+  // Workers collect stats for the whole launch (or batch) if they were enabled when it started
+  launch_ns_ = stats_.Enabled() ? StatsRecorder::NowNs() : 0;
+  started_.store(false, std::memory_order_relaxed);
+  last_task_ns_.store(0, std::memory_order_relaxed);
+}
+
+void TaskRunnerStealing::RunWorker(int worker, Runnable* runnable, int num_tasks, int all_seeded,
+                                   int launch) {
+  const int num_workers = workers_.NumWorkers();
+  WorkStealingDeque<int>& own = *deques_[worker];
+
+  // All workers participate in every launch, so they agree on whether the previous assignment
+  // matches this launch and each task id is seeded exactly once
+  Assignment* assignment = sticky_ ? &assignments_[worker] : nullptr;
+  if (assignment && assignment->num_tasks == num_tasks) {
+    // Seed our deque with the tasks we executed last time, in the same order
+    for (auto it = assignment->tasks.rbegin(); it != assignment->tasks.rend(); ++it) own.Push(*it);
+  } else {
+    // Seed our deque with a contiguous slice of the task ids. We push the slice in reverse so that
+    // we execute it in ascending order while thieves take from the far end.
+    int begin = static_cast<int>(static_cast<int64_t>(num_tasks) * worker / num_workers);
+    int end = static_cast<int>(static_cast<int64_t>(num_tasks) * (worker + 1) / num_workers);
+    for (int i = end - 1; i >= begin; i--) own.Push(i);
+  }
+  num_seeded_.fetch_add(1, std::memory_order_release);
+  if (assignment) {
+    assignment->num_tasks = num_tasks;
+    assignment->tasks.clear();
+  }
+  const bool stats = launch_ns_ != 0;
+  auto run_task = [&](int task_id) {
+    // Like the other runners, time to the first task executed rather than to the first worker up
+    if (stats && !started_.load(std::memory_order_relaxed) &&
+        !started_.exchange(true, std::memory_order_relaxed)) {
+      stats_.AddFirstTask(launch_ns_);
+    }
+    RunTasks(runnable, task_id, task_id + 1, num_tasks, worker, launch);
+    if (assignment) assignment->tasks.push_back(task_id);
+  };
+
+  ScopedCurrentRunner current(this, worker);
+
+  int task_id;
+  int victim_offset = worker + 1;
+  int64_t idle_ns = 0;  // Start of the current sequence of unsuccessful steal attempts
+  while (true) {
+    if (stats) {
+      int64_t start_ns = StatsRecorder::NowNs();
+      int count = 0;
+      for (; own.Pop(&task_id); count++) run_task(task_id);
+      if (count > 0) {
+        int64_t end_ns = StatsRecorder::NowNs();
+        stats_.AddBusy(worker, count, end_ns - start_ns);
+        StatsRecorder::UpdateMax(last_task_ns_, end_ns);
+      }
+    } else {
+      while (own.Pop(&task_id)) {
+        run_task(task_id);
+      }
+    }
+
+    // Our deque is empty, try to steal from the other workers starting with a different victim
+    // each time to spread out the contention
+    bool seeded = num_seeded_.load(std::memory_order_acquire) == all_seeded;
+    bool all_empty = true;
+    for (int k = 0; k < num_workers; k++) {
+      int victim = (victim_offset + k) % num_workers;
+      if (victim == worker) continue;
+      auto result = deques_[victim]->Steal(&task_id);
+      if (result == WorkStealingDeque<int>::StealResult::kSuccess) {
+        if (tracer_.Enabled()) tracer_.AddSteal(worker, victim);
+        if (stats) {
+          int64_t start_ns = StatsRecorder::NowNs();
+          if (idle_ns != 0) stats_.AddIdle(worker, start_ns - idle_ns);
+          idle_ns = 0;
+          run_task(task_id);
+          int64_t end_ns = StatsRecorder::NowNs();
+          stats_.AddSteal(worker);
+          stats_.AddBusy(worker, 1, end_ns - start_ns);
+          StatsRecorder::UpdateMax(last_task_ns_, end_ns);
+        } else {
+          run_task(task_id);
+        }
+        all_empty = false;
+        victim_offset = victim;  // Revisit a productive victim first
+        break;
+      } else if (result == WorkStealingDeque<int>::StealResult::kAbort) {
+        all_empty = false;
+      }
+    }
+
+    // Deques are only filled during seeding, so once every worker has seeded its deque and we
+    // observe all of them empty there is no work left to claim
+    if (seeded && all_empty) break;
+    if (all_empty) {
+      if (stats && idle_ns == 0) idle_ns = StatsRecorder::NowNs();
+      std::this_thread::yield();
+    }
+  }
+  if (stats && idle_ns != 0) stats_.AddIdle(worker, StatsRecorder::NowNs() - idle_ns);
+}
+
+
+TaskRunnerQueue::TaskRunnerQueue(int num_threads)
+    : num_threads_(std::max(num_threads, 1)), waiters_(num_threads_), exit_(false) {
+  // The thread calling Run also executes tasks
+  for (int i = 1; i < num_threads_; i++) {
+    threads_.emplace_back(&TaskRunnerQueue::WorkerLoop, this, i);
+  }
+}
+
+TaskRunnerQueue::~TaskRunnerQueue() {
+  exit_.store(true, std::memory_order_release);
+  work_event_.NotifyAll();
+  for (auto& thread : threads_) thread.join();
+}
+
+void TaskRunnerQueue::Run(Runnable* runnable, int num_tasks) {
+  if (num_tasks <= 0) return;
+
+  // A few chunks per thread so that threads finishing early can pick up the slack
+  const int kChunksPerThread = 4;
+  const int chunk_size = std::max(1, num_tasks / (kChunksPerThread * num_threads_));
+
+  bool stats = stats_.Enabled();
+  Launch launch{runnable, num_tasks, {num_tasks}, stats ? StatsRecorder::NowNs() : 0, {0},
+                tracer_.NewLaunch()};
+  for (int begin = 0; begin < num_tasks; begin += chunk_size) {
+    Chunk chunk{&launch, begin, std::min(begin + chunk_size, num_tasks)};
+    if (!queue_.TryPush(chunk)) {
+      // Let the workers start on what is already queued while we execute this chunk
+      work_event_.NotifyAll();
+      RunChunk(chunk, 0);
+    }
+  }
+  work_event_.NotifyAll();
+
+  // Help with any queued chunks, including those of other launches, until our launch is done
+  SpinThenPark& waiter = waiters_[0];
+  while (launch.num_remaining.load(std::memory_order_acquire) > 0) {
+    Chunk chunk;
+    if (queue_.TryPop(&chunk)) {
+      RunChunk(chunk, 0);
+    } else {
+      ScopedIdle idle(stats_, 0);
+      waiter.Wait(done_event_,
+                  [&] { return launch.num_remaining.load(std::memory_order_acquire) == 0; });
+    }
+  }
+  if (stats) stats_.AddReturn(launch.last_task_ns.load(std::memory_order_relaxed));
+}
+
+void TaskRunnerQueue::WorkerLoop(int worker) {
+  SpinThenPark& waiter = waiters_[worker];
+  while (true) {
+    Chunk chunk;
+    if (queue_.TryPop(&chunk)) {
+      RunChunk(chunk, worker);
+      continue;
+    }
+    if (exit_.load(std::memory_order_acquire)) return;
+    ScopedIdle idle(stats_, worker);
+    waiter.Wait(work_event_, [this] {
+      return queue_.SizeApprox() > 0 || exit_.load(std::memory_order_acquire);
+    });
+  }
+}
+
+void TaskRunnerQueue::RunChunk(const Chunk& chunk, int worker) {
+  Launch* launch = chunk.launch;
+  if (launch->launch_ns != 0 && stats_.Enabled()) {
+    stats_.AddClaim(worker);
+    if (chunk.begin == 0) stats_.AddFirstTask(launch->launch_ns);
+    int64_t start_ns = StatsRecorder::NowNs();
+    RunTasks(launch->runnable, chunk.begin, chunk.end, launch->num_tasks, worker,
+             launch->trace_id);
+    int64_t end_ns = StatsRecorder::NowNs();
+    stats_.AddBusy(worker, chunk.end - chunk.begin, end_ns - start_ns);
+    StatsRecorder::UpdateMax(launch->last_task_ns, end_ns);
+  } else {
+    RunTasks(launch->runnable, chunk.begin, chunk.end, launch->num_tasks, worker,
+             launch->trace_id);
+  }
+  // The launching thread may return (destroying the launch) as soon as the count reaches zero so
+  // we can't touch the launch after the decrement
+  int count = chunk.end - chunk.begin;
+  if (launch->num_remaining.fetch_sub(count, std::memory_order_acq_rel) == count) {
+    done_event_.NotifyAll();
+  }
 }
 
-TaskRunnerSleep::TaskRunnerSleep(int num_threads) : num_threads_(num_threads) {}
 
-TaskRunnerSleep::~TaskRunnerSleep() {}
+TaskRunnerPartitioned::TaskRunnerPartitioned(int num_threads)
+    : workers_(std::max(num_threads, 1)) {}
 
+void TaskRunnerPartitioned::Run(Runnable* runnable, int num_tasks) {
+  if (num_tasks <= 0) return;
+  if (current_runner == this) {
+    RunTasks(runnable, 0, num_tasks, num_tasks, current_worker, tracer_.NewLaunch());
+    return;
+  }
+  std::lock_guard<std::mutex> lock(launch_mutex_);
+
+  std::vector<double> costs(num_tasks);
+  bool hinted = false;
+  for (int i = 0; i < num_tasks; i++) {
+    costs[i] = runnable->TaskCost(i, num_tasks);
+    hinted = hinted || costs[i] > 0.;
+  }
+
+  // Without hints we measure every task and use the history of this type of Runnable
+  CostHistory* history = nullptr;
+  if (!hinted) {
+    history = &history_[std::type_index(typeid(*runnable))];
+    if (history->num_tasks == num_tasks) {
+      costs = history->task_ns;
+    } else {
+      costs.assign(num_tasks, 1.);
+    }
+    durations_.assign(num_tasks, 0.);
+  }
+  Partition(costs);
+
+  const bool stats = stats_.Enabled();
+  const int launch = tracer_.NewLaunch();
+  workers_.Run([&](int worker) {
+    ScopedCurrentRunner current(this, worker);
+    int begin = bounds_[worker];
+    int end = bounds_[worker + 1];
+    int64_t start_ns = stats ? StatsRecorder::NowNs() : 0;
+    if (history) {
+      auto task_start = std::chrono::steady_clock::now();
+      for (int i = begin; i < end; i++) {
+        RunTasks(runnable, i, i + 1, num_tasks, worker, launch);
+        auto task_end = std::chrono::steady_clock::now();
+        durations_[i] = std::chrono::duration<double, std::nano>(task_end - task_start).count();
+        task_start = task_end;
+      }
+    } else {
+      RunTasks(runnable, begin, end, num_tasks, worker, launch);
+    }
+    if (stats) stats_.AddBusy(worker, end - begin, StatsRecorder::NowNs() - start_ns);
+  });
+
+  if (history) {
+    if (history->num_tasks != num_tasks) {
+      history->num_tasks = num_tasks;
+      history->task_ns = durations_;
+    } else {
+      for (int i = 0; i < num_tasks; i++) {
+        history->task_ns[i] = (3. * history->task_ns[i] + durations_[i]) / 4.;
+      }
+    }
+  }
+}
+
+void TaskRunnerPartitioned::Partition(const std::vector<double>& costs) {
+  const int num_workers = workers_.NumWorkers();
+  const int num_tasks = static_cast<int>(costs.size());
+  std::vector<double> prefix(num_tasks + 1, 0.);
+  for (int i = 0; i < num_tasks; i++) prefix[i + 1] = prefix[i] + std::max(costs[i], 0.);
+
+  bounds_.assign(num_workers + 1, num_tasks);
+  bounds_[0] = 0;
+  for (int w = 1; w < num_workers; w++) {
+    // First task whose preceding tasks cover worker w's share of the total cost
+    double target = prefix[num_tasks] * w / num_workers;
+    int bound = static_cast<int>(std::lower_bound(prefix.begin(), prefix.end(), target) -
+                                 prefix.begin());
+    // Split before or after the task that straddles the target, whichever is closer
+    if (bound > 0 && bound <= num_tasks && target - prefix[bound - 1] < prefix[bound] - target) {
+      bound--;
+    }
+    bounds_[w] = std::max(bounds_[w - 1], std::min(bound, num_tasks));
+  }
+}
+
+
+TaskRunnerSplitting::TaskRunnerSplitting(int num_threads)
+    : workers_(std::max(num_threads, 1)), launch_(-1), num_remaining_(0), num_thieves_(0) {
+  for (int i = 0; i < workers_.NumWorkers(); i++) {
+    deques_.emplace_back(new WorkStealingDeque<Range>());
+  }
+}
+
+void TaskRunnerSplitting::Run(Runnable* runnable, int num_tasks) {
+  if (num_tasks <= 0) return;
+  if (current_runner == this) {
+    RunTasks(runnable, 0, num_tasks, num_tasks, current_worker, tracer_.NewLaunch());
+    return;
+  }
+  std::lock_guard<std::mutex> lock(launch_mutex_);
+  num_remaining_.store(num_tasks, std::memory_order_relaxed);
+  num_thieves_.store(0, std::memory_order_relaxed);
+  launch_ = tracer_.NewLaunch();
+  workers_.Run([&](int worker) { RunWorker(worker, runnable, num_tasks); });
+}
+
+void TaskRunnerSplitting::RunWorker(int worker, Runnable* runnable, int num_tasks) {
+  const int num_workers = workers_.NumWorkers();
+  WorkStealingDeque<Range>& own = *deques_[worker];
+  ScopedCurrentRunner current(this, worker);
+
+  // Start with a contiguous slice of the tasks, later ranges come from our own splits or thefts
+  Range range{static_cast<int>(static_cast<int64_t>(num_tasks) * worker / num_workers),
+              static_cast<int>(static_cast<int64_t>(num_tasks) * (worker + 1) / num_workers)};
+  ExecuteRange(worker, runnable, range, num_tasks);
+
+  int victim_offset = worker + 1;
+  bool stealing = false;
+  while (true) {
+    if (own.Pop(&range)) {
+      ExecuteRange(worker, runnable, range, num_tasks);
+      continue;
+    }
+    // Ranges are only pushed by workers that still have unexecuted tasks, so there is nothing
+    // left to steal once all of the tasks have been executed
+    if (num_remaining_.load(std::memory_order_acquire) == 0) break;
+
+    if (!stealing) {
+      num_thieves_.fetch_add(1, std::memory_order_relaxed);
+      stealing = true;
+    }
+    bool found = false;
+    for (int k = 0; k < num_workers && !found; k++) {
+      int victim = (victim_offset + k) % num_workers;
+      if (victim == worker) continue;
+      if (deques_[victim]->Steal(&range) == WorkStealingDeque<Range>::StealResult::kSuccess) {
+        num_thieves_.fetch_sub(1, std::memory_order_relaxed);
+        stealing = false;
+        if (stats_.Enabled()) stats_.AddSteal(worker);
+        if (tracer_.Enabled()) tracer_.AddSteal(worker, victim);
+        ExecuteRange(worker, runnable, range, num_tasks);
+        victim_offset = victim;  // Revisit a productive victim first
+        found = true;
+      }
+    }
+    if (!found) std::this_thread::yield();
+  }
+  if (stealing) num_thieves_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void TaskRunnerSplitting::ExecuteRange(int worker, Runnable* runnable, Range range,
+                                       int num_tasks) {
+  const bool stats = stats_.Enabled();
+  WorkStealingDeque<Range>& own = *deques_[worker];
+  int chunk = 1;
+  while (range.begin < range.end) {
+    // Split off the upper half for a thief, unless our deque already has a range for them
+    if (range.end - range.begin > 1 && num_thieves_.load(std::memory_order_relaxed) > 0 &&
+        own.Size() == 0) {
+      int mid = range.begin + (range.end - range.begin) / 2;
+      own.Push(Range{mid, range.end});
+      range.end = mid;
+      chunk = 1;
+      continue;
+    }
+
+    // Grow the chunks while nobody needs work, but always keep half of the range available for
+    // splitting
+    int count = std::min(chunk, std::max(1, (range.end - range.begin) / 2));
+    int64_t start_ns = stats ? StatsRecorder::NowNs() : 0;
+    RunTasks(runnable, range.begin, range.begin + count, num_tasks, worker, launch_);
+    if (stats) stats_.AddBusy(worker, count, StatsRecorder::NowNs() - start_ns);
+    range.begin += count;
+    num_remaining_.fetch_sub(count, std::memory_order_acq_rel);
+    chunk *= 2;
+  }
+}
+
+thread_local TaskRunnerFiber::Worker* TaskRunnerFiber::current_fiber_worker_ = nullptr;
+
+void TaskYield() {
+  TaskRunnerFiber::Worker* worker = TaskRunnerFiber::current_fiber_worker_;
+  if (worker == nullptr || worker->current == nullptr) {
+    std::this_thread::yield();
+    return;
+  }
+  Fiber* fiber = worker->current;
+  worker->ready.push_back(fiber);
+  ScratchArena* arena = current_arena;
+  Fiber::Switch(*fiber, worker->scheduler);
+  current_arena = arena;
+}
+
+void TaskSleepFor(std::chrono::nanoseconds duration) {
+  TaskRunnerFiber::Worker* worker = TaskRunnerFiber::current_fiber_worker_;
+  if (worker == nullptr || worker->current == nullptr) {
+    std::this_thread::sleep_for(duration);
+    return;
+  }
+  Fiber* fiber = worker->current;
+  worker->sleeping.emplace(StatsRecorder::NowNs() + duration.count(), fiber);
+  ScratchArena* arena = current_arena;
+  Fiber::Switch(*fiber, worker->scheduler);
+  current_arena = arena;
+}
+
+TaskRunnerFiber::TaskRunnerFiber(int num_threads)
+    : workers_(std::max(num_threads, 1)),
+      runnable_(nullptr),
+      num_tasks_(0),
+      launch_(-1),
+      next_task_(0) {
+  for (int i = 0; i < workers_.NumWorkers(); i++) {
+    states_.emplace_back(new Worker());
+    states_.back()->runner = this;
+    states_.back()->index = i;
+  }
+}
+
+void TaskRunnerFiber::Run(Runnable* runnable, int num_tasks) {
+  if (num_tasks <= 0) return;
+  if (current_runner == this) {
+    RunTasks(runnable, 0, num_tasks, num_tasks, current_worker, tracer_.NewLaunch());
+    return;
+  }
+  std::lock_guard<std::mutex> lock(launch_mutex_);
+  runnable_ = runnable;
+  num_tasks_ = num_tasks;
+  launch_ = tracer_.NewLaunch();
+  next_task_.store(0, std::memory_order_relaxed);
+  workers_.Run([this](int worker) { RunWorker(worker); });
+}
+
+void TaskRunnerFiber::FiberMain(void* arg) {
+  Worker& worker = *static_cast<Worker*>(arg);
+  TaskRunnerFiber& runner = *worker.runner;
+  // Tasks on different fibers of a worker interleave, so each fiber needs its own arena. A new
+  // fiber is switched to right after it is started, so its arena is the last one added.
+  ScratchArena& arena = *worker.arenas.back();
+  while (true) {
+    current_arena = &arena;
+    const bool stats = runner.stats_.Enabled();
+    int task;
+    while ((task = runner.next_task_.fetch_add(1, std::memory_order_relaxed)) < runner.num_tasks_) {
+      // Busy time includes any time the task spends suspended
+      int64_t start_ns = stats ? StatsRecorder::NowNs() : 0;
+      runner.RunTasks(runner.runnable_, task, task + 1, runner.num_tasks_, worker.index,
+                      runner.launch_);
+      if (stats) runner.stats_.AddBusy(worker.index, 1, StatsRecorder::NowNs() - start_ns);
+    }
+    // Wait in the idle list until a later launch has tasks to claim
+    worker.idle.push_back(worker.current);
+    Fiber::Switch(*worker.current, worker.scheduler);
+  }
+}
+
+void TaskRunnerFiber::RunWorker(int index) {
+  Worker& worker = *states_[index];
+  ScopedCurrentRunner current(this, index);
+  Worker* prev_worker = current_fiber_worker_;
+  current_fiber_worker_ = &worker;
+
+  while (true) {
+    int64_t now_ns = worker.sleeping.empty() ? 0 : StatsRecorder::NowNs();
+    while (!worker.sleeping.empty() && worker.sleeping.top().first <= now_ns) {
+      worker.ready.push_back(worker.sleeping.top().second);
+      worker.sleeping.pop();
+    }
+
+    Fiber* next = nullptr;
+    if (!worker.ready.empty()) {
+      next = worker.ready.front();
+      worker.ready.pop_front();
+    } else if (next_task_.load(std::memory_order_relaxed) < num_tasks_ &&
+               (!worker.idle.empty() ||
+                static_cast<int>(worker.fibers.size()) < kMaxFibersPerWorker)) {
+      if (worker.idle.empty()) {
+        worker.fibers.emplace_back(new Fiber(Fiber::kDefaultStackSize));
+        worker.arenas.emplace_back(new ScratchArena());
+        worker.fibers.back()->Start(&TaskRunnerFiber::FiberMain, &worker);
+        next = worker.fibers.back().get();
+      } else {
+        next = worker.idle.back();
+        worker.idle.pop_back();
+      }
+    } else if (!worker.sleeping.empty()) {
+      // Every unfinished task on this worker is asleep
+      ScopedIdle idle(stats_, index);
+      std::this_thread::sleep_for(std::chrono::nanoseconds(worker.sleeping.top().first - now_ns));
+      continue;
+    } else {
+      break;  // All of our tasks are complete and there are none left to claim
+    }
+
+    worker.current = next;
+    ScratchArena* arena = current_arena;
+    Fiber::Switch(worker.scheduler, *next);
+    current_arena = arena;
+    worker.current = nullptr;
+  }
+
+  current_fiber_worker_ = prev_worker;
+}
@@ -1,8 +1,33 @@
 #pragma once
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <thread>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
 #include <vector>
+#include "arena.h"
+#include "fiber.h"
+#include "mpmc-queue.h"
+#include "stats.h"
+#include "sync.h"
+#include "topology.h"
+#include "trace.h"
+#include "ws-deque.h"
+
+/**
+ * @brief Information about the worker executing a task
+ */
+struct TaskContext {
+  int worker;           // Index of the worker within its runner, 0 for the launching thread
+  ScratchArena& arena;  // Scratch memory private to the worker, released once the task returns
+};
 
 /**
  * @brief Abstract base case class for all tasks
@@ -18,6 +43,78 @@ class Runnable {
    * @param task_count Total number of tasks to be executed
    */
   virtual void RunTask(int task_id, int task_count) = 0;
+
+  /**
+   * @brief Execute the tasks with ids in [begin, end)
+   *
+   * Runners call this for chunks of tasks. Override it to avoid a virtual call per task, or to
+   * process a range more efficiently than task by task.
+   */
+  virtual void RunRange(int begin, int end, int task_count) {
+    for (int i = begin; i < end; i++) RunTask(i, task_count);
+  }
+
+  /**
+   * @brief Execute the tasks with ids in [begin, end) on the worker described by context
+   *
+   * This is the overload the runners call. By default it ignores the context.
+   */
+  virtual void RunRange(int begin, int end, int task_count, TaskContext& context) {
+    RunRange(begin, end, task_count);
+  }
+
+  /**
+   * @brief Optional estimate of the relative cost of a task, used by runners that partition the
+   * tasks up front
+   *
+   * @return Cost in arbitrary units consistent across the tasks of a launch, 0 if unknown
+   */
+  virtual double TaskCost(int task_id, int task_count) const { return 0.; }
+};
+
+/**
+ * @brief Base class for tasks that use their TaskContext, e.g. to allocate temporary buffers from
+ * the worker's scratch arena instead of the heap
+ */
+class ContextRunnable : public Runnable {
+ public:
+  /**
+   * @brief Method invoked by task runner, memory allocated from context.arena is released when it
+   * returns
+   */
+  virtual void RunTask(int task_id, int task_count, TaskContext& context) = 0;
+
+  /**
+   * @brief Execute a task with a context for the calling thread, for callers without a context
+   */
+  void RunTask(int task_id, int task_count) override;
+
+  using Runnable::RunRange;
+  void RunRange(int begin, int end, int task_count, TaskContext& context) override {
+    for (int i = begin; i < end; i++) {
+      ScratchArena::Marker marker = context.arena.Mark();
+      RunTask(i, task_count, context);
+      context.arena.Release(marker);
+    }
+  }
+};
+
+/**
+ * @brief Identifier for an asynchronous bulk launch
+ */
+typedef int TaskID;
+
+/**
+ * @brief Priority class of a launch
+ *
+ * Runners that support priorities execute the ready tasks of higher-priority launches first, and
+ * the others ignore the priority.
+ */
+enum class TaskPriority : int {
+  kHigh = 0,  // Latency-sensitive launches
+  kNormal,    // The priority of launches without one
+  kLow,       // Background launches
+  kNumPriorities,
 };
 
 /**
@@ -25,6 +122,7 @@ class Runnable {
  */
 class TaskRunner {
  public:
+  TaskRunner() : next_task_id_(0) {}
   virtual ~TaskRunner() {}
 
   /**
@@ -33,6 +131,91 @@ class TaskRunner {
    * @param num_tasks Number of tasks to launch
    */
   virtual void Run(Runnable* runnable, int num_tasks) = 0;
+
+  /**
+   * @brief Bulk launch tasks that may not start until the specified launches have completed.
+   * May return before the tasks have completed.
+   *
+   * The default implementation executes the launch synchronously with Run.
+   *
+   * @param runnable Task to execute
+   * @param num_tasks Number of tasks to launch
+   * @param deps Launches that must complete before any of these tasks can start
+   * @return TaskID Identifier for this launch that can be used as a dependency of later launches
+   */
+  virtual TaskID RunAsyncWithDeps(Runnable* runnable, int num_tasks,
+                                  const std::vector<TaskID>& deps);
+
+  /**
+   * @brief Bulk launch tasks with a priority class, returning once they have completed
+   *
+   * The default implementation ignores the priority and calls Run.
+   */
+  virtual void Run(Runnable* runnable, int num_tasks, TaskPriority priority) {
+    Run(runnable, num_tasks);
+  }
+
+  /**
+   * @brief RunAsyncWithDeps with a priority class
+   *
+   * The default implementation ignores the priority.
+   */
+  virtual TaskID RunAsyncWithDeps(Runnable* runnable, int num_tasks,
+                                  const std::vector<TaskID>& deps, TaskPriority priority) {
+    return RunAsyncWithDeps(runnable, num_tasks, deps);
+  }
+
+  /**
+   * @brief Execute a sequence of bulk launches in order, each starting once the previous one
+   * completes, returning once all of them complete
+   *
+   * The default implementation calls Run for each launch. Runners can override this to avoid
+   * returning to the caller (and waking the workers again) between the launches.
+   *
+   * @param launches Task to execute and number of tasks for each launch
+   */
+  virtual void RunBatch(const std::vector<std::pair<Runnable*, int>>& launches);
+
+  /**
+   * @brief Wait for all previously launched tasks to complete
+   */
+  virtual void Sync() {}
+
+  /**
+   * @brief Maximum number of tasks the runner executes concurrently
+   */
+  virtual int NumThreads() const { return 1; }
+
+  /**
+   * @brief Start collecting scheduling statistics (discarding any collected so far) or stop
+   */
+  void EnableStats(bool enable) { stats_.Enable(enable, NumThreads()); }
+
+  /**
+   * @brief Statistics collected since EnableStats, empty for runners that don't collect them
+   */
+  RunnerStats Stats() const { return stats_.Snapshot(); }
+
+  /**
+   * @brief Start recording a timeline of executed tasks (discarding any recorded so far) or stop
+   */
+  void EnableTrace(bool enable) { tracer_.Enable(enable); }
+
+  /**
+   * @brief Events recorded since EnableTrace, call between launches
+   */
+  std::vector<TraceEvent> Trace() const { return tracer_.Events(); }
+
+ protected:
+  /**
+   * @brief Execute tasks [begin, end) of runnable as worker, recording them as part of launch if
+   * tracing is enabled
+   */
+  void RunTasks(Runnable* runnable, int begin, int end, int num_tasks, int worker, int launch);
+
+  TaskID next_task_id_;
+  StatsRecorder stats_;
+  TaskTracer tracer_;
 };
 
 class TaskRunnerSerial : public TaskRunner {
@@ -45,29 +228,526 @@ class TaskRunnerSpawn : public TaskRunner {
   TaskRunnerSpawn(int num_threads) : num_threads_(num_threads) {}
 
   void Run(Runnable* runnable, int num_tasks) override;
+  int NumThreads() const override { return num_threads_; }
 
  private:
   int num_threads_;
 };
 
-class TaskRunnerSpin : public TaskRunner {
+/**
+ * @brief How pool runners hand out the task ids in a launch to their threads
+ */
+enum class SchedulePolicy : int {
+  kDynamic = 0,  // One task at a time
+  kStatic,       // One equal-sized chunk per thread
+  kGuided,       // Chunks that shrink toward the tail and grow with cheaper tasks
+};
+
+/**
+ * @brief Determine the size of the next chunk of task ids to claim
+ *
+ * For kGuided the chunk is the larger of a share of the remaining tasks (like OpenMP's guided
+ * schedule) and enough tasks to amortize the dispatch overhead, as determined by the per-task cost
+ * measured for the launch's previously executed chunks. It never exceeds an equal share of the
+ * remaining tasks per worker, so cheap early chunks can't leave the rest of a launch to one thread.
+ */
+class TaskChunker {
  public:
-  TaskRunnerSpin(int num_threads);
-  ~TaskRunnerSpin();
+  TaskChunker(SchedulePolicy policy, int num_workers)
+      : policy_(policy), num_workers_(num_workers) {}
 
+  SchedulePolicy Policy() const { return policy_; }
+
+  /**
+   * @brief Whether the runner should time chunks and report them with Record
+   */
+  bool Timed() const { return policy_ == SchedulePolicy::kGuided; }
+
+  /**
+   * @brief Number of tasks to claim next
+   * @param remaining Number of unclaimed tasks in the launch
+   * @param num_tasks Total number of tasks in the launch
+   * @param task_ns The launch's per-task cost estimate, 0 if not yet measured
+   */
+  int ChunkSize(int remaining, int num_tasks, int64_t task_ns) const;
+
+  /**
+   * @brief Fold a chunk's timing into a launch's per-task cost estimate
+   * @param task_ns The current estimate, 0 if not yet measured
+   * @param count Number of tasks in the chunk
+   * @param elapsed_ns Time spent executing the chunk
+   * @return The updated estimate
+   */
+  static int64_t Record(int64_t task_ns, int count, int64_t elapsed_ns);
+
+ private:
+  SchedulePolicy policy_;
+  int num_workers_;
+};
+
+/**
+ * @brief Thread pool with persistent threads shared by TaskRunnerSpin, TaskRunnerSleep and
+ * TaskRunnerHybrid
+ *
+ * Supports asynchronous launches with dependencies. Launches become "ready" once all of their
+ * dependencies have completed and the workers (and any thread waiting in Run or Sync) execute
+ * chunks of tasks from the ready launches in launch order. The runners differ only in how idle
+ * threads wait for work.
+ *
+ * Tasks may call Run on the same runner. Such a nested launch only waits for its own tasks, and the
+ * launching thread executes them (or, once they are all claimed, tasks of the most recent launch)
+ * instead of blocking.
+ *
+ * Each priority class has its own queue of ready launches, and threads claim tasks from the
+ * highest-priority launch that has any. Tasks of kLow launches are claimed one at a time, so a
+ * higher-priority launch waits for at most one background task per worker.
+ */
+class TaskRunnerPool : public TaskRunner {
+ public:
+  ~TaskRunnerPool();
+
+  /**
+   * @brief Bulk launch tasks, returning once those and all previously launched tasks complete.
+   * When called from one of the runner's tasks, returns once just these tasks complete.
+   */
   void Run(Runnable* runnable, int num_tasks) override;
+  TaskID RunAsyncWithDeps(Runnable* runnable, int num_tasks,
+                          const std::vector<TaskID>& deps) override;
+
+  /**
+   * @brief Bulk launch tasks with a priority, returning once just these tasks complete
+   *
+   * The calling thread only executes tasks of this launch, so it isn't held up by other launches.
+   */
+  void Run(Runnable* runnable, int num_tasks, TaskPriority priority) override;
+  TaskID RunAsyncWithDeps(Runnable* runnable, int num_tasks, const std::vector<TaskID>& deps,
+                          TaskPriority priority) override;
+
+  /**
+   * @brief Chain the launches with dependencies so the caller only waits once
+   */
+  void RunBatch(const std::vector<std::pair<Runnable*, int>>& launches) override;
+
+  /**
+   * @brief Wait for all launches to complete, must not be called from the runner's tasks
+   */
+  void Sync() override;
+  int NumThreads() const override { return num_threads_; }
+
+  /**
+   * @brief Let the number of workers taking work vary with the load, between min_threads and the
+   * number of threads the pool was created with (a min_threads of at least that restores a fixed
+   * size)
+   *
+   * The highest active worker parks once it hasn't executed a task for kParkAfterIdleNs, and parked
+   * workers are added back one at a time while the unclaimed tasks stay above kGrowTasksPerWorker
+   * per active worker for kGrowAfterNs. Resizing in either direction must also wait that long
+   * after the last resize, and parking takes much longer than growing, so the pool doesn't thrash
+   * between sizes.
+   */
+  void SetElastic(int min_threads);
+
+  /**
+   * @brief Number of workers currently taking work, NumThreads unless the pool is elastic
+   */
+  int NumActiveThreads() const { return num_active_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Print the CPU each worker thread is pinned to
+   */
+  void DumpPlacement(FILE* file) const;
+
+ protected:
+  enum class WaitMode { kSpin, kSleep, kHybrid };
+
+  /**
+   * @param num_threads Number of threads executing tasks, including the thread calling Run/Sync
+   * @param mode How idle threads wait for work
+   * @param policy How tasks are divided among the threads
+   * @param placement How worker threads are pinned to CPUs. The first CPU in the placement is left
+   * for the thread calling Run/Sync, which is not pinned.
+   */
+  TaskRunnerPool(int num_threads, WaitMode mode, SchedulePolicy policy,
+                 PlacementPolicy placement);
 
  private:
+  struct Launch {
+    TaskID id;
+    Runnable* runnable;
+    int num_tasks;
+    int next_task;
+    int num_finished;
+    int num_pending_deps;
+    std::vector<Launch*> dependents;
+    int64_t ready_ns;  // When the launch became ready, if collecting stats
+    TaskPriority priority;
+    int64_t task_ns;  // Moving average of the per-task cost (kGuided), 0 if not yet measured
+  };
+
+  static constexpr int64_t kGrowAfterNs = 1000000;
+  static constexpr int64_t kParkAfterIdleNs = 50000000;
+  static constexpr int kGrowTasksPerWorker = 2;
+
+  void WorkerLoop(int worker);
+  /**
+   * @brief Wait for the launch id to complete, executing its tasks and, if help is set, tasks of
+   * the most recent launch once all of its tasks are claimed
+   */
+  void WaitForLaunch(TaskID id, int worker, bool help);
+  bool RunChunkLocked(std::unique_lock<std::mutex>& lock, int worker, TaskID preferred = -1);
+  void MakeReadyLocked(Launch* launch);
+  void CompleteLocked(Launch* launch);
+
+  /**
+   * @brief Grow or shrink the set of active workers if the load warrants it (elastic pools only)
+   */
+  void ResizeLocked(int64_t now_ns);
+
+  /**
+   * @brief Wait until worker is active again (or the pool exits), if it isn't active
+   * @return true if the worker was inactive
+   */
+  bool ParkIfInactiveLocked(std::unique_lock<std::mutex>& lock, int worker);
+
   int num_threads_;
+  WaitMode mode_;
+  TaskChunker chunker_;
+  std::vector<SpinThenPark> waiters_;  // Hybrid-mode spin tuning per worker, 0 for callers
+  CpuTopology topology_;
+  std::vector<int> placement_;  // CPU for each worker, -1 if unpinned
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  EventCount event_;  // Notified when work becomes ready, all launches complete or on exit
+  std::deque<Launch*> ready_[static_cast<int>(TaskPriority::kNumPriorities)];
+  std::unordered_map<TaskID, std::unique_ptr<Launch>> incomplete_;
+  // Number of ready launches and incomplete_.size(), so spinning threads can poll without the lock
+  std::atomic<int> num_ready_;
+  std::atomic<int> num_incomplete_;
+  std::atomic<uint64_t> num_completed_;  // Lets nested launches wait for any launch to complete
+  int num_launch_waiters_;  // Threads in WaitForLaunch
+  std::atomic<bool> exit_;
+  int64_t last_complete_ns_;  // When the last incomplete launch completed, if collecting stats
+
+  std::atomic<bool> elastic_;
+  int min_threads_;
+  std::atomic<int> num_active_;  // Workers [0, num_active_) take work, the others are parked
+  int num_unclaimed_;            // Unclaimed tasks in the ready launches
+  int64_t high_since_ns_;        // Since when num_unclaimed_ has been high, 0 if it isn't
+  int64_t last_resize_ns_;
+  std::vector<int64_t> idle_since_ns_;  // When each worker last finished a chunk, 0 while busy
+  std::condition_variable park_cv_;
+};
+
+/**
+ * @brief Thread pool whose idle threads spin waiting for work
+ */
+class TaskRunnerSpin : public TaskRunnerPool {
+ public:
+  TaskRunnerSpin(int num_threads, SchedulePolicy policy = SchedulePolicy::kGuided,
+                 PlacementPolicy placement = PlacementPolicy::kNone)
+      : TaskRunnerPool(num_threads, WaitMode::kSpin, policy, placement) {}
+};
+
+/**
+ * @brief Thread pool whose idle threads sleep on a condition variable
+ */
+class TaskRunnerSleep : public TaskRunnerPool {
+ public:
+  TaskRunnerSleep(int num_threads, SchedulePolicy policy = SchedulePolicy::kGuided,
+                  PlacementPolicy placement = PlacementPolicy::kNone)
+      : TaskRunnerPool(num_threads, WaitMode::kSleep, policy, placement) {}
+};
+
+/**
+ * @brief Thread pool whose idle threads spin for a bounded, self-tuning interval and then park on
+ * a futex
+ *
+ * Spinning gives low latency for bursts of back-to-back launches while parking ensures idle
+ * threads don't consume CPU time.
+ */
+class TaskRunnerHybrid : public TaskRunnerPool {
+ public:
+  TaskRunnerHybrid(int num_threads, SchedulePolicy policy = SchedulePolicy::kGuided,
+                   PlacementPolicy placement = PlacementPolicy::kNone)
+      : TaskRunnerPool(num_threads, WaitMode::kHybrid, policy, placement) {}
+};
+
+/**
+ * @brief Persistent set of worker threads that all execute the same function for each launch
+ *
+ * The calling thread participates as worker 0, so a group with num_workers workers creates
+ * num_workers - 1 threads. Idle workers sleep on a condition variable.
+ */
+class WorkerGroup {
+ public:
+  WorkerGroup(int num_workers);
+  ~WorkerGroup();
+
+  int NumWorkers() const { return static_cast<int>(threads_.size()) + 1; }
+
+  /**
+   * @brief Invoke body(worker_index) on every worker, returning when all invocations are complete
+   * @param body Function to execute on each worker
+   */
+  void Run(const std::function<void(int)>& body);
+
+ private:
+  void WorkerLoop(int worker);
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(int)>* body_;
+  uint64_t epoch_;
+  int num_running_;
+  bool exit_;
 };
 
-class TaskRunnerSleep : public TaskRunner {
+/**
+ * @brief Runner where each worker executes its share of the tasks and then steals from the others
+ *
+ * Launches from within the runner's tasks are executed serially by the launching thread.
+ */
+class TaskRunnerStealing : public TaskRunner {
  public:
-  TaskRunnerSleep(int num_threads);
-  ~TaskRunnerSleep();
+  TaskRunnerStealing(int num_threads) : TaskRunnerStealing(num_threads, false) {}
 
   void Run(Runnable* runnable, int num_tasks) override;
 
+  /**
+   * @brief Execute all of the launches in a single round of the workers, separated by barriers
+   */
+  void RunBatch(const std::vector<std::pair<Runnable*, int>>& launches) override;
+  int NumThreads() const override { return workers_.NumWorkers(); }
+
+ protected:
+  /**
+   * @param sticky Seed each worker with the tasks it executed in the previous launch with the same
+   * number of tasks, instead of a contiguous slice
+   */
+  TaskRunnerStealing(int num_threads, bool sticky);
+
  private:
+  /**
+   * @brief Task ids a worker executed in its most recent launch
+   */
+  struct alignas(64) Assignment {
+    int num_tasks = -1;
+    std::vector<int> tasks;
+  };
+
+  /**
+   * @param all_seeded Value of num_seeded_ once all workers have seeded their deques
+   * @param launch Trace id of the launch
+   */
+  void RunWorker(int worker, Runnable* runnable, int num_tasks, int all_seeded, int launch);
+  void StartLaunch();
+
+  std::mutex launch_mutex_;  // Serializes launches from multiple threads
+  WorkerGroup workers_;
+  SenseBarrier barrier_;  // Separates the launches in RunBatch
+  std::vector<std::unique_ptr<WorkStealingDeque<int>>> deques_;
+  bool sticky_;
+  std::vector<Assignment> assignments_;  // Only accessed by the corresponding worker
+  std::atomic<int> num_seeded_;
+  // Timestamps for the current launch if collecting stats, launch_ns_ is 0 otherwise
+  int64_t launch_ns_;
+  std::atomic<bool> started_;
+  std::atomic<int64_t> last_task_ns_;
+};
+
+/**
+ * @brief Work-stealing runner that keeps each task id on the same worker across launches
+ *
+ * Successive launches with the same number of tasks (e.g. the PingPong launches) seed each
+ * worker with the task ids it executed in the previous launch, including the ones it stole, so
+ * that a task finds the data written by its predecessor in the same core's caches. Stealing
+ * remains as the fallback for imbalance.
+ */
+class TaskRunnerSticky : public TaskRunnerStealing {
+ public:
+  TaskRunnerSticky(int num_threads) : TaskRunnerStealing(num_threads, true) {}
+};
+
+
+/**
+ * @brief Thread pool whose workers pull chunks of tasks from a lock-free MPMC queue
+ *
+ * Run can be called concurrently from multiple threads. Each launch is split into chunks that are
+ * pushed onto the shared queue without taking a lock, and the launching thread executes chunks
+ * (of any launch) from the queue until its own launch is complete. If the queue is full, the
+ * launching thread executes the chunk itself. Idle threads spin briefly and then park.
+ */
+class TaskRunnerQueue : public TaskRunner {
+ public:
+  TaskRunnerQueue(int num_threads);
+  ~TaskRunnerQueue();
+
+  void Run(Runnable* runnable, int num_tasks) override;
+  int NumThreads() const override { return num_threads_; }
+
+ private:
+  struct Launch {
+    Runnable* runnable;
+    int num_tasks;
+    std::atomic<int> num_remaining;
+    int64_t launch_ns;                  // When the launch started, if collecting stats
+    std::atomic<int64_t> last_task_ns;  // When the last task finished, if collecting stats
+    int trace_id;                       // Id of the launch if tracing
+  };
+
+  struct Chunk {
+    Launch* launch;
+    int begin;
+    int end;
+  };
+
+  void WorkerLoop(int worker);
+  void RunChunk(const Chunk& chunk, int worker);
+
   int num_threads_;
+  std::vector<SpinThenPark> waiters_;  // Spin tuning per worker, 0 for callers
+  MpmcQueue<Chunk> queue_;
+  EventCount work_event_;  // Notified when chunks are pushed and on exit
+  EventCount done_event_;  // Notified when a launch completes
+  std::atomic<bool> exit_;
+  std::vector<std::thread> threads_;
+};
+
+/**
+ * @brief Runner that divides each launch into one contiguous range of tasks per worker, balanced
+ * by the expected cost of the tasks
+ *
+ * The costs come from Runnable::TaskCost if the runnable provides them and otherwise from the
+ * task durations measured in previous launches of the same Runnable type with the same number of
+ * tasks (assuming equal costs for the first launch). There is no dynamic scheduling, so launches
+ * from within the runner's tasks are executed serially by the launching thread.
+ */
+class TaskRunnerPartitioned : public TaskRunner {
+ public:
+  TaskRunnerPartitioned(int num_threads);
+
+  void Run(Runnable* runnable, int num_tasks) override;
+  int NumThreads() const override { return workers_.NumWorkers(); }
+
+ private:
+  struct CostHistory {
+    int num_tasks = 0;
+    std::vector<double> task_ns;  // Moving average of the duration of each task
+  };
+
+  /**
+   * @brief Set bounds_ so the tasks are split into contiguous ranges of equal total cost
+   */
+  void Partition(const std::vector<double>& costs);
+
+  std::mutex launch_mutex_;  // Serializes launches from multiple threads
+  WorkerGroup workers_;
+  std::vector<int> bounds_;  // Worker w executes tasks [bounds_[w], bounds_[w + 1])
+  std::vector<double> durations_;  // Measured duration of each task in the current launch
+  std::unordered_map<std::type_index, CostHistory> history_;
+};
+
+/**
+ * @brief Work-stealing runner that hands out ranges of tasks and splits them lazily
+ *
+ * Each worker starts with a contiguous range of the tasks and executes it in chunks that grow
+ * while no other worker is looking for work. When there are thieves and our deque is empty, the
+ * worker pushes the upper half of its remaining range to its deque for them to steal. Coarse
+ * launches are thus split as finely as needed for balance, while fine-grained launches are
+ * executed with a few large RunRange calls. Launches from within the runner's tasks are executed
+ * serially by the launching thread.
+ */
+class TaskRunnerSplitting : public TaskRunner {
+ public:
+  TaskRunnerSplitting(int num_threads);
+
+  void Run(Runnable* runnable, int num_tasks) override;
+  int NumThreads() const override { return workers_.NumWorkers(); }
+
+ private:
+  struct Range {
+    int begin;
+    int end;
+  };
+
+  void RunWorker(int worker, Runnable* runnable, int num_tasks);
+  void ExecuteRange(int worker, Runnable* runnable, Range range, int num_tasks);
+
+  std::mutex launch_mutex_;  // Serializes launches from multiple threads
+  WorkerGroup workers_;
+  std::vector<std::unique_ptr<WorkStealingDeque<Range>>> deques_;
+  int launch_;  // Trace id of the current launch
+  alignas(64) std::atomic<int> num_remaining_;  // Tasks not yet executed in the current launch
+  alignas(64) std::atomic<int> num_thieves_;    // Workers currently looking for work
+};
+
+/**
+ * @brief Let other work run on the current worker
+ *
+ * Tasks executed by TaskRunnerFiber switch to another of the worker's fibers; other callers yield
+ * the thread.
+ */
+void TaskYield();
+
+/**
+ * @brief Block the calling task for at least duration
+ *
+ * Tasks executed by TaskRunnerFiber suspend their fiber so that the worker can execute other tasks
+ * in the meantime; other callers sleep the thread.
+ */
+void TaskSleepFor(std::chrono::nanoseconds duration);
+
+/**
+ * @brief Runner that executes tasks on user-space fibers so that blocked tasks don't idle workers
+ *
+ * Each worker claims tasks one at a time on a fiber. When a task blocks with TaskYield or
+ * TaskSleepFor, the worker switches to another ready fiber or starts a fiber to claim the next
+ * task, and only sleeps once no tasks are left to claim and all of its unfinished tasks are
+ * sleeping. Fibers stay on the worker that started them and are reused across launches. Launches
+ * from within the runner's tasks are executed serially by the launching fiber.
+ */
+class TaskRunnerFiber : public TaskRunner {
+ public:
+  TaskRunnerFiber(int num_threads);
+
+  void Run(Runnable* runnable, int num_tasks) override;
+  int NumThreads() const override { return workers_.NumWorkers(); }
+
+ private:
+  friend void TaskYield();
+  friend void TaskSleepFor(std::chrono::nanoseconds duration);
+
+  static const int kMaxFibersPerWorker = 256;
+
+  using Sleeper = std::pair<int64_t, Fiber*>;  // Wake time (StatsRecorder::NowNs) and fiber
+
+  struct Worker {
+    TaskRunnerFiber* runner;
+    int index;
+    Fiber scheduler;                             // Context of the worker's scheduling loop
+    Fiber* current = nullptr;                    // Fiber being executed, if any
+    std::vector<std::unique_ptr<Fiber>> fibers;  // All of the fibers started by the worker
+    std::vector<std::unique_ptr<ScratchArena>> arenas;  // Scratch arena for each fiber
+    std::vector<Fiber*> idle;                    // Fibers waiting to claim a task
+    std::deque<Fiber*> ready;                    // Fibers whose task yielded
+    std::priority_queue<Sleeper, std::vector<Sleeper>, std::greater<Sleeper>> sleeping;
+  };
+
+  static void FiberMain(void* arg);
+  void RunWorker(int worker);
+
+  // Worker whose scheduling loop is running on this thread, if any
+  static thread_local Worker* current_fiber_worker_;
+
+  std::mutex launch_mutex_;  // Serializes launches from multiple threads
+  WorkerGroup workers_;
+  std::vector<std::unique_ptr<Worker>> states_;
+  Runnable* runnable_;
+  int num_tasks_;
+  int launch_;  // Trace id of the current launch
+  alignas(64) std::atomic<int> next_task_;  // Next task to claim in the current launch
 };
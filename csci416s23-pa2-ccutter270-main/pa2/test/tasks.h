@@ -5,22 +5,36 @@
  */
 #pragma once
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
+#include <ctime>
+#include <limits>
 #include <map>
 #include <thread>
 #include "CycleTimer.h"
+#include "parallel.h"
 #include "tasksys.h"
 
 class TestResult {
  public:
-  TestResult() : correct_(true), exec_time_(0.) {}
+  TestResult() : correct_(true), exec_time_(0.), cpu_time_(0.) {}
 
   bool correct_;
   double exec_time_;
+  double cpu_time_;  // CPU time consumed by all threads in the process
 };
 
+/**
+ * @brief CPU time consumed so far by all threads in the process
+ */
+inline double CpuSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 typedef TestResult (*TestFunction)(TaskRunner&);
 
 class ValidatorTask : public Runnable {
@@ -46,6 +60,10 @@ class FastTask : public Runnable {
 
   void RunTask(int task_id, int num_tasks) override { output_[task_id] = task_id; }
 
+  void RunRange(int begin, int end, int num_tasks) override {
+    for (int i = begin; i < end; i++) output_[i] = i;
+  }
+
  protected:
   int* output_;
 };
@@ -70,6 +88,35 @@ class RecursiveFibonacciTask : public Runnable {
   int n_;
 };
 
+/**
+ * @brief Compute fib(n) by launching two tasks, for fib(n - 1) and fib(n - 2), on the same runner
+ * until n reaches the cutoff
+ */
+class ParallelFibonacciTask : public Runnable {
+ public:
+  ParallelFibonacciTask(TaskRunner& runner, int n, int cutoff)
+      : runner_(runner), n_(n), cutoff_(cutoff), results_{0, 0} {}
+
+  void RunTask(int task_id, int num_tasks) override {
+    int n = n_ - 1 - task_id;
+    if (n <= cutoff_) {
+      results_[task_id] = RecursiveFibonacciTask::RecursiveFibonacci(n);
+    } else {
+      ParallelFibonacciTask child(runner_, n, cutoff_);
+      runner_.Run(&child, 2);
+      results_[task_id] = child.Result();
+    }
+  }
+
+  int Result() const { return results_[0] + results_[1]; }
+
+ protected:
+  TaskRunner& runner_;
+  int n_;
+  int cutoff_;
+  int results_[2];
+};
+
 class PingPongTask : public Runnable {
  public:
   PingPongTask(int num_elements, int* input_array, int* output_array, bool equal_work,
@@ -110,6 +157,22 @@ class PingPongTask : public Runnable {
     }
   }
 
+  void RunRange(int begin, int end, int num_tasks) override {
+    // Avoid the virtual call for each task
+    for (int i = begin; i < end; i++) PingPongTask::RunTask(i, num_tasks);
+  }
+
+  double TaskCost(int task_id, int num_tasks) const override {
+    int elements_per_task = (num_elements_ + num_tasks - 1) / num_tasks;
+    int start_index = elements_per_task * task_id;
+    int end_index = std::min(start_index + elements_per_task, num_elements_);
+    if (start_index >= end_index) return 0.;
+    // The iterations decrease linearly, so the middle element has the average cost. The extra 1
+    // accounts for the per-element overhead.
+    int iterations = equal_work_ ? iterations_ : NumIterations((start_index + end_index) / 2);
+    return static_cast<double>(end_index - start_index) * (iterations + 1);
+  }
+
  protected:
   int num_elements_;
   int* input_array_;
@@ -118,13 +181,50 @@ class PingPongTask : public Runnable {
   int iterations_;
 };
 
+/**
+ * @brief Tasks whose cost decreases linearly with the task id, without a cost hint
+ */
+class SkewedWorkTask : public Runnable {
+ public:
+  SkewedWorkTask(int output[], int iterations) : output_(output), iterations_(iterations) {}
+
+  void RunTask(int task_id, int num_tasks) override {
+    output_[task_id] = PingPongTask::Work(iterations_ * (num_tasks - task_id), task_id);
+  }
+
+ protected:
+  int* output_;
+  int iterations_;
+};
+
+class ElementwiseAddTask : public Runnable {
+ public:
+  ElementwiseAddTask(int num_elements, const unsigned* a, const unsigned* b, unsigned* output,
+                     unsigned addend)
+      : num_elements_(num_elements), a_(a), b_(b), output_(output), addend_(addend) {}
+
+  void RunTask(int task_id, int num_tasks) override {
+    int elements_per_task = (num_elements_ + num_tasks - 1) / num_tasks;
+    int start_index = elements_per_task * task_id;
+    int end_index = std::min(start_index + elements_per_task, num_elements_);
+    for (int i = start_index; i < end_index; i++) output_[i] = a_[i] + b_[i] + addend_;
+  }
+
+ protected:
+  int num_elements_;
+  const unsigned* a_;
+  const unsigned* b_;
+  unsigned* output_;
+  unsigned addend_;
+};
+
 class SleepTask : public Runnable {
  public:
   SleepTask() : seconds_(1) {}
   SleepTask(int seconds) : seconds_(seconds) {}
 
   void RunTask(int task_id, int num_total_tasks) override {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    TaskSleepFor(std::chrono::seconds(1));
     fprintf(stderr, "Completed task with ID %d (of %d tasks)\n", task_id, num_total_tasks);
   }
 
@@ -132,8 +232,85 @@ class SleepTask : public Runnable {
   int seconds_;
 };
 
+/**
+ * @brief Task that alternates between computing and blocking (e.g. waiting for I/O)
+ */
+class ComputeSleepTask : public Runnable {
+ public:
+  ComputeSleepTask(int output[], int steps, int n, std::chrono::microseconds sleep)
+      : output_(output), steps_(steps), n_(n), sleep_(sleep) {}
+
+  void RunTask(int task_id, int num_tasks) override {
+    int sum = 0;
+    for (int i = 0; i < steps_; i++) {
+      sum += RecursiveFibonacciTask::RecursiveFibonacci(n_);
+      TaskSleepFor(sleep_);
+    }
+    output_[task_id] = sum;
+  }
+
+ protected:
+  int* output_;
+  int steps_;
+  int n_;
+  std::chrono::microseconds sleep_;
+};
+
+/**
+ * @brief Task that needs a few small temporary buffers, from the heap or the worker's scratch arena
+ */
+class ScratchBufferTask : public ContextRunnable {
+ public:
+  static const int kBuffersPerTask = 8;
+
+  ScratchBufferTask(long long output[], bool use_arena) : output_(output), use_arena_(use_arena) {}
+
+  static int BufferSize(int task_id, int buffer) { return 8 + (task_id * 7 + buffer * 13) % 56; }
+
+  /**
+   * @brief Value stored in element i of a buffer, summed into the task's output
+   */
+  static int Element(int task_id, int buffer, int i) { return (task_id ^ i) + buffer; }
+
+  void RunTask(int task_id, int num_tasks, TaskContext& context) override {
+    long long sum = 0;
+    for (int b = 0; b < kBuffersPerTask; b++) {
+      int size = BufferSize(task_id, b);
+      if (use_arena_) {
+        int* buffer = context.arena.AllocateArray<int>(size);
+        sum += Fill(buffer, size, task_id, b);
+      } else {
+        std::vector<int> buffer(size);
+        sum += Fill(buffer.data(), size, task_id, b);
+      }
+    }
+    output_[task_id] = sum;
+  }
+
+ protected:
+  static long long Fill(int* buffer, int size, int task_id, int b) {
+    for (int i = 0; i < size; i++) buffer[i] = Element(task_id, b, i);
+    long long sum = 0;
+    for (int i = 0; i < size; i++) sum += buffer[i];
+    return sum;
+  }
+
+  long long* output_;
+  bool use_arena_;
+};
+
+/**
+ * @brief How PingPongTest issues its back-to-back launches
+ */
+enum class LaunchStyle {
+  kRun,    // One Run per launch
+  kAsync,  // Chained RunAsyncWithDeps and a single Sync
+  kBatch,  // A single RunBatch
+};
+
 TestResult PingPongTest(TaskRunner& runner, bool equal_work, int num_elements, int base_iterations,
-                        int num_tasks = 64, int num_bulk_task_launches = 400) {
+                        int num_tasks = 64, int num_bulk_task_launches = 400,
+                        LaunchStyle style = LaunchStyle::kRun) {
   std::vector<int> input(num_elements);
   std::vector<int> output(num_elements);
 
@@ -156,12 +333,30 @@ TestResult PingPongTest(TaskRunner& runner, bool equal_work, int num_elements, i
 
   // Run the test
   double start_time = CycleTimer::currentSeconds();
-
-  for (int i = 0; i < num_bulk_task_launches; i++) {
-    runner.Run(&runnables[i], num_tasks);
+  double start_cpu = CpuSeconds();
+
+  if (style == LaunchStyle::kAsync) {
+    // Each launch depends on the previous launch, but we only wait once at the end
+    std::vector<TaskID> deps;
+    for (int i = 0; i < num_bulk_task_launches; i++) {
+      TaskID id = runner.RunAsyncWithDeps(&runnables[i], num_tasks, deps);
+      deps.assign(1, id);
+    }
+    runner.Sync();
+  } else if (style == LaunchStyle::kBatch) {
+    std::vector<std::pair<Runnable*, int>> launches;
+    for (int i = 0; i < num_bulk_task_launches; i++) {
+      launches.emplace_back(&runnables[i], num_tasks);
+    }
+    runner.RunBatch(launches);
+  } else {
+    for (int i = 0; i < num_bulk_task_launches; i++) {
+      runner.Run(&runnables[i], num_tasks);
+    }
   }
 
   double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
 
   // Correctness validation
   TestResult results;
@@ -184,6 +379,7 @@ TestResult PingPongTest(TaskRunner& runner, bool equal_work, int num_elements, i
     }
   }
   results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
 
   return results;
 }
@@ -197,12 +393,14 @@ TestResult FewUnbalancedTest(TaskRunner& runner, int num_small_tasks = 1, int nu
 
   // Run the test
   double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
 
   runner.Run(&small_task, num_small_tasks);
   runner.Run(&med_task, num_med_tasks);
   runner.Run(&small_task, num_small_tasks);
 
   double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
 
   // Correctness validation
   TestResult results;
@@ -216,6 +414,7 @@ TestResult FewUnbalancedTest(TaskRunner& runner, int num_small_tasks = 1, int nu
     }
   }
   results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
 
   return results;
 }
@@ -246,6 +445,349 @@ TestResult PingPongUnequalTest(TaskRunner& runner) {
   return PingPongTest(runner, false, num_elements, base_iters);
 }
 
+TestResult AsyncChainTest(TaskRunner& runner) {
+  const int num_elements = 32 * 1024;
+  const int base_iters = 32;
+  return PingPongTest(runner, true, num_elements, base_iters, 64, 400, LaunchStyle::kAsync);
+}
+
+TestResult BatchChainTest(TaskRunner& runner) {
+  const int num_elements = 32 * 1024;
+  const int base_iters = 32;
+  return PingPongTest(runner, true, num_elements, base_iters, 64, 400, LaunchStyle::kBatch);
+}
+
+const int kDiamondRounds = 100;
+
+TestResult DiamondDepsTest(TaskRunner& runner) {
+  const int num_elements = 32 * 1024;
+  const int num_tasks = 64;
+  std::vector<unsigned> w(num_elements), x(num_elements), y(num_elements), z(num_elements);
+  std::vector<unsigned> zeros(num_elements, 0);
+  for (int i = 0; i < num_elements; i++) w[i] = i;
+
+  // Each round is the diamond x = w + 1, then y = x + x and z = x + 1 (which can run concurrently),
+  // then w = y + z. The next round depends on the last launch of the previous round.
+  ElementwiseAddTask a(num_elements, w.data(), zeros.data(), x.data(), 1);
+  ElementwiseAddTask b(num_elements, x.data(), x.data(), y.data(), 0);
+  ElementwiseAddTask c(num_elements, x.data(), zeros.data(), z.data(), 1);
+  ElementwiseAddTask d(num_elements, y.data(), z.data(), w.data(), 0);
+
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  std::vector<TaskID> deps;
+  for (int r = 0; r < kDiamondRounds; r++) {
+    TaskID a_id = runner.RunAsyncWithDeps(&a, num_tasks, deps);
+    TaskID b_id = runner.RunAsyncWithDeps(&b, num_tasks, {a_id});
+    TaskID c_id = runner.RunAsyncWithDeps(&c, num_tasks, {a_id});
+    TaskID d_id = runner.RunAsyncWithDeps(&d, num_tasks, {b_id, c_id});
+    deps.assign(1, d_id);
+  }
+  runner.Sync();
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  TestResult results;
+  for (int i = 0; i < num_elements; i++) {
+    unsigned v = i;
+    for (int r = 0; r < kDiamondRounds; r++) {
+      unsigned xv = v + 1;
+      v = (xv + xv) + (xv + 1);
+    }
+    if (w[i] != v) {
+      results.correct_ = false;
+      fprintf(stderr, "DiamondDepsTest error at index (%d) - Expected value: %u, Actual value: %u\n",
+              i, v, w[i]);
+      break;
+    }
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+const int kFanRounds = 50;
+const int kFanWidth = 32;
+
+TestResult FanOutFanInTest(TaskRunner& runner) {
+  const int num_elements = 32 * 1024;
+  const int segment = num_elements / kFanWidth;
+  std::vector<unsigned> w(num_elements), x(num_elements), y(num_elements);
+  std::vector<unsigned> zeros(num_elements, 0);
+  for (int i = 0; i < num_elements; i++) w[i] = i;
+
+  // Each round a single root launch (x = w + 1) fans out to kFanWidth independent launches that
+  // each update a disjoint segment (y = x + x + j), which then fan in to a single launch (w = y + x)
+  ElementwiseAddTask root(num_elements, w.data(), zeros.data(), x.data(), 1);
+  std::vector<ElementwiseAddTask> branches;
+  for (int j = 0; j < kFanWidth; j++) {
+    int offset = j * segment;
+    branches.emplace_back(segment, x.data() + offset, x.data() + offset, y.data() + offset, j);
+  }
+  ElementwiseAddTask join(num_elements, y.data(), x.data(), w.data(), 0);
+
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  std::vector<TaskID> deps;
+  for (int r = 0; r < kFanRounds; r++) {
+    TaskID root_id = runner.RunAsyncWithDeps(&root, 64, deps);
+    deps.clear();
+    for (auto& branch : branches) {
+      deps.push_back(runner.RunAsyncWithDeps(&branch, 4, {root_id}));
+    }
+    TaskID join_id = runner.RunAsyncWithDeps(&join, 64, deps);
+    deps.assign(1, join_id);
+  }
+  runner.Sync();
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  TestResult results;
+  for (int i = 0; i < num_elements; i++) {
+    unsigned v = i;
+    for (int r = 0; r < kFanRounds; r++) {
+      unsigned xv = v + 1;
+      v = (xv + xv + (i / segment)) + xv;
+    }
+    if (w[i] != v) {
+      results.correct_ = false;
+      fprintf(stderr, "FanOutFanInTest error at index (%d) - Expected value: %u, Actual value: %u\n",
+              i, v, w[i]);
+      break;
+    }
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+TestResult ParallelForTest(TaskRunner& runner) {
+  const int num_elements = 32 * 1024;
+  const int num_launches = 400;
+  std::vector<int> input(num_elements);
+  std::vector<int> output(num_elements, 0);
+  for (int i = 0; i < num_elements; i++) input[i] = i;
+
+  // Ping-pong buffers with tiny loop bodies (like FastTask) defined inline
+  int* in = input.data();
+  int* out = output.data();
+
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  for (int i = 0; i < num_launches; i++) {
+    ParallelFor(runner, 0, num_elements, 512, [=](int j) { out[j] = in[j] + 1; });
+    std::swap(in, out);
+  }
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  TestResult results;
+  for (int i = 0; i < num_elements; i++) {
+    if (in[i] != i + num_launches) {
+      results.correct_ = false;
+      fprintf(stderr, "ParallelForTest error at index (%d) - Expected value: %d, Actual value: %d\n",
+              i, i + num_launches, in[i]);
+      break;
+    }
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+TestResult ParallelReduceTest(TaskRunner& runner) {
+  const int num_elements = 1024 * 1024;
+  const int num_launches = 100;
+  std::vector<int> input(num_elements);
+  for (int i = 0; i < num_elements; i++) input[i] = i;
+
+  std::vector<int64_t> sums(num_launches);
+
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  for (int i = 0; i < num_launches; i++) {
+    sums[i] = ParallelReduce(
+        runner, BlockedRange(0, num_elements, 1024), static_cast<int64_t>(0),
+        [&](int j) { return static_cast<int64_t>(input[j]) * input[j] + i; },
+        [](int64_t a, int64_t b) { return a + b; });
+  }
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  // Sum of squares 0..n-1, offset by the launch index for every element
+  TestResult results;
+  const int64_t n = num_elements;
+  const int64_t sum_of_squares = (n - 1) * n * (2 * n - 1) / 6;
+  for (int i = 0; i < num_launches; i++) {
+    int64_t expected = sum_of_squares + i * n;
+    if (sums[i] != expected) {
+      results.correct_ = false;
+      fprintf(stderr,
+              "ParallelReduceTest error on launch %d - Expected value: %lld, Actual value: %lld\n",
+              i, static_cast<long long>(expected), static_cast<long long>(sums[i]));
+      break;
+    }
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+TestResult ParallelReduceLargeTest(TaskRunner& runner) {
+  // Enough blocks (grain 1) that blocks * tasks overflows an int for any number of threads, ending
+  // at INT_MAX so the last block's bounds are at the edge of the int range too
+  const int num_elements = 600 * 1000 * 1000;
+  const int end = std::numeric_limits<int>::max();
+  const int begin = end - num_elements;
+
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  int64_t sum = ParallelReduce(
+      runner, BlockedRange(begin, end, 1), static_cast<int64_t>(0),
+      [](int j) { return static_cast<int64_t>(j); }, [](int64_t a, int64_t b) { return a + b; });
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  TestResult results;
+  const int64_t expected = (static_cast<int64_t>(begin) + end - 1) * num_elements / 2;
+  if (sum != expected) {
+    results.correct_ = false;
+    fprintf(stderr, "ParallelReduceLargeTest error - Expected value: %lld, Actual value: %lld\n",
+            static_cast<long long>(expected), static_cast<long long>(sum));
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+TestResult NestedFibonacciTest(TaskRunner& runner) {
+  const int n = 32;
+  const int cutoff = 18;
+  ParallelFibonacciTask task(runner, n, cutoff);
+
+  // Run the test
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  runner.Run(&task, 2);
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  // Correctness validation
+  TestResult results;
+  int expected = RecursiveFibonacciTask::RecursiveFibonacci(n);
+  if (task.Result() != expected) {
+    results.correct_ = false;
+    fprintf(stderr, "NestedFibonacci error - Expected value: %d, Actual value: %d\n", expected,
+            task.Result());
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+TestResult LearnedUnequalTest(TaskRunner& runner) {
+  const int num_tasks = 64;
+  const int num_launches = 100;
+  const int iterations = 2000;
+  std::vector<int> output(num_tasks);
+  SkewedWorkTask task(output.data(), iterations);
+
+  // Run the test
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  for (int i = 0; i < num_launches; i++) {
+    runner.Run(&task, num_tasks);
+  }
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  // Correctness validation
+  TestResult results;
+  for (int i = 0; i < num_tasks; i++) {
+    int expected = PingPongTask::Work(iterations * (num_tasks - i), i);
+    if (output[i] != expected) {
+      results.correct_ = false;
+      fprintf(stderr, "LearnedUnequal error at index (%d) - Expected value: %d, Actual value: %d\n",
+              i, expected, output[i]);
+      break;
+    }
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+const int kProducers = 4;
+const int kProducerLaunches = 100;
+
+TestResult MultiProducerTest(TaskRunner& runner) {
+  const int num_elements = 64 * 1024;
+  const int num_tasks = 64;
+  const std::vector<unsigned> zeros(num_elements, 0);
+  std::vector<std::vector<unsigned>> outputs(kProducers, std::vector<unsigned>(num_elements, 0));
+
+  // Each producer repeatedly increments its own array: output = output + 0 + 1
+  std::vector<ElementwiseAddTask> runnables;
+  for (int p = 0; p < kProducers; p++) {
+    runnables.emplace_back(num_elements, outputs[p].data(), zeros.data(), outputs[p].data(), 1);
+  }
+
+  // Run the test
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; p++) {
+    producers.emplace_back([&runner, &runnables, p] {
+      for (int i = 0; i < kProducerLaunches; i++) runner.Run(&runnables[p], num_tasks);
+    });
+  }
+  for (auto& producer : producers) producer.join();
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  // Correctness validation
+  TestResult results;
+  for (int p = 0; p < kProducers && results.correct_; p++) {
+    for (int i = 0; i < num_elements; i++) {
+      if (outputs[p][i] != kProducerLaunches) {
+        results.correct_ = false;
+        fprintf(stderr,
+                "MultiProducer error for producer %d at index (%d) - Expected value: %d, Actual "
+                "value: %u\n",
+                p, i, kProducerLaunches, outputs[p][i]);
+        break;
+      }
+    }
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
 TestResult OnlyRunsTaskOnce(TaskRunner& runner) {
   const int num_launches = 2;
   std::vector<ValidatorTask> runnables;
@@ -255,12 +797,14 @@ TestResult OnlyRunsTaskOnce(TaskRunner& runner) {
 
   // Run the test
   double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
 
   for (int i = 0; i < num_launches; i++) {
     runner.Run(&runnables[i], 100);
   }
 
   double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
 
   // Correctness validation
   TestResult results;
@@ -273,6 +817,153 @@ TestResult OnlyRunsTaskOnce(TaskRunner& runner) {
     }
   }
   results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+TestResult ScratchBufferTest(TaskRunner& runner, bool use_arena) {
+  const int num_tasks = 16 * 1024;
+  const int num_launches = 20;
+  std::vector<long long> output(num_tasks, 0);
+  ScratchBufferTask task(output.data(), use_arena);
+
+  // Run the test
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  for (int i = 0; i < num_launches; i++) runner.Run(&task, num_tasks);
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  // Correctness validation
+  TestResult results;
+  for (int t = 0; t < num_tasks; t++) {
+    long long expected = 0;
+    for (int b = 0; b < ScratchBufferTask::kBuffersPerTask; b++) {
+      for (int i = 0; i < ScratchBufferTask::BufferSize(t, b); i++) {
+        expected += ScratchBufferTask::Element(t, b, i);
+      }
+    }
+    if (output[t] != expected) {
+      results.correct_ = false;
+      fprintf(stderr,
+              "ScratchBufferTest error at index (%d) - Expected value: %lld, Actual value: %lld\n",
+              t, expected, output[t]);
+      break;
+    }
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+TestResult ScratchMallocTest(TaskRunner& runner) { return ScratchBufferTest(runner, false); }
+
+TestResult ScratchArenaTest(TaskRunner& runner) { return ScratchBufferTest(runner, true); }
+
+/**
+ * @brief Launch short high-priority FastTask launches while another thread keeps the runner busy
+ * with low-priority RecursiveFibonacciTask launches
+ *
+ * The reported time is the total latency of the high-priority launches, rather than the time for
+ * the whole test.
+ */
+TestResult MixedPriorityTest(TaskRunner& runner) {
+  const int num_background_tasks = 32;
+  const int num_fast_launches = 50;
+  const int num_fast_tasks = 64;
+  const int n = 25;
+
+  std::vector<int> background_output(num_background_tasks, 0);
+  std::vector<int> fast_output(num_fast_tasks, -1);
+  RecursiveFibonacciTask background(background_output.data(), n);
+  FastTask fast(fast_output.data());
+
+  std::atomic<bool> stop(false);
+  std::atomic<bool> started(false);
+  std::thread batch([&] {
+    while (!stop.load()) {
+      started.store(true);
+      runner.Run(&background, num_background_tasks, TaskPriority::kLow);
+    }
+  });
+  while (!started.load()) std::this_thread::yield();
+
+  // Run the test
+  double latency = 0.;
+  double start_cpu = CpuSeconds();
+
+  for (int i = 0; i < num_fast_launches; i++) {
+    double start_time = CycleTimer::currentSeconds();
+    runner.Run(&fast, num_fast_tasks, TaskPriority::kHigh);
+    latency += CycleTimer::currentSeconds() - start_time;
+    // Requests arrive spaced out rather than back to back
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+
+  double end_cpu = CpuSeconds();
+  stop.store(true);
+  batch.join();
+
+  // Correctness validation
+  TestResult results;
+  int expected = RecursiveFibonacciTask::RecursiveFibonacci(n);
+  for (int i = 0; i < num_background_tasks; i++) {
+    if (background_output[i] != expected) {
+      results.correct_ = false;
+      fprintf(stderr,
+              "MixedPriorityTest error at index (%d) - Expected value: %d, Actual value: %d\n", i,
+              expected, background_output[i]);
+      break;
+    }
+  }
+  for (int i = 0; i < num_fast_tasks && results.correct_; i++) {
+    if (fast_output[i] != i) {
+      results.correct_ = false;
+      fprintf(stderr,
+              "MixedPriorityTest error at index (%d) - Expected value: %d, Actual value: %d\n", i,
+              i, fast_output[i]);
+    }
+  }
+  results.exec_time_ = latency;
+  results.cpu_time_ = end_cpu - start_cpu;
+
+  return results;
+}
+
+TestResult MixedComputeSleepTest(TaskRunner& runner) {
+  const int num_tasks = 128;
+  const int steps = 4;
+  const int n = 22;
+  std::vector<int> output(num_tasks, 0);
+  ComputeSleepTask task(output.data(), steps, n, std::chrono::microseconds(1000));
+
+  // Run the test
+  double start_time = CycleTimer::currentSeconds();
+  double start_cpu = CpuSeconds();
+
+  runner.Run(&task, num_tasks);
+
+  double end_time = CycleTimer::currentSeconds();
+  double end_cpu = CpuSeconds();
+
+  // Correctness validation
+  TestResult results;
+  int expected = steps * RecursiveFibonacciTask::RecursiveFibonacci(n);
+  for (int i = 0; i < num_tasks; i++) {
+    if (output[i] != expected) {
+      results.correct_ = false;
+      fprintf(stderr,
+              "MixedComputeSleepTest error at index (%d) - Expected value: %d, Actual value: %d\n",
+              i, expected, output[i]);
+      break;
+    }
+  }
+  results.exec_time_ = end_time - start_time;
+  results.cpu_time_ = end_cpu - start_cpu;
 
   return results;
 }
@@ -288,6 +979,20 @@ const std::map<TestFunction, const char*> kTestFunctions = {
     TEST_FUNCTION(PingPongUnequalTest),
     TEST_FUNCTION(SpinBetweenTasks),
     TEST_FUNCTION(OnlyRunsTaskOnce),
+    TEST_FUNCTION(AsyncChainTest),
+    TEST_FUNCTION(BatchChainTest),
+    TEST_FUNCTION(DiamondDepsTest),
+    TEST_FUNCTION(FanOutFanInTest),
+    TEST_FUNCTION(ParallelForTest),
+    TEST_FUNCTION(ParallelReduceTest),
+    TEST_FUNCTION(ParallelReduceLargeTest),
+    TEST_FUNCTION(MultiProducerTest),
+    TEST_FUNCTION(NestedFibonacciTest),
+    TEST_FUNCTION(LearnedUnequalTest),
+    TEST_FUNCTION(MixedComputeSleepTest),
+    TEST_FUNCTION(ScratchMallocTest),
+    TEST_FUNCTION(ScratchArenaTest),
+    TEST_FUNCTION(MixedPriorityTest),
     // clang-format on
 };
 
@@ -0,0 +1,175 @@
+#include "topology.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Parse a sysfs CPU list, e.g. "0-3,8,10-11"
+ */
+std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty() || range == "\n") continue;
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+bool ReadFile(const std::string& path, std::string* contents) {
+  std::ifstream file(path);
+  if (!file) return false;
+  std::getline(file, *contents);
+  return true;
+}
+
+bool ReadInt(const std::string& path, int* value) {
+  std::string contents;
+  if (!ReadFile(path, &contents) || contents.empty()) return false;
+  *value = std::stoi(contents);
+  return true;
+}
+
+/**
+ * @brief CPUs this process is allowed to run on, or an empty vector if unknown
+ */
+std::vector<int> AllowedCpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+  }
+#endif
+  return cpus;
+}
+
+}  // namespace
+
+CpuTopology CpuTopology::Discover(const std::string& sysfs_root) {
+  std::vector<int> candidates;
+  std::string online;
+  if (ReadFile(sysfs_root + "/online", &online)) candidates = ParseCpuList(online);
+
+  std::vector<int> allowed = AllowedCpus();
+  if (candidates.empty()) {
+    candidates = allowed;
+  } else if (!allowed.empty()) {
+    std::vector<int> both;
+    std::set_intersection(candidates.begin(), candidates.end(), allowed.begin(), allowed.end(),
+                          std::back_inserter(both));
+    candidates = both;
+  }
+  if (candidates.empty()) {
+    for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); cpu++) {
+      candidates.push_back(cpu);
+    }
+  }
+
+  CpuTopology topology;
+  for (int cpu : candidates) {
+    std::string dir = sysfs_root + "/cpu" + std::to_string(cpu) + "/topology/";
+    CpuInfo info{cpu, cpu, 0, 0};
+    if (!ReadInt(dir + "core_id", &info.core) ||
+        !ReadInt(dir + "physical_package_id", &info.socket)) {
+      info.core = cpu;
+      info.socket = 0;
+    }
+    topology.cpus_.push_back(info);
+  }
+
+  // Number the hardware threads within each core in CPU id order
+  std::sort(topology.cpus_.begin(), topology.cpus_.end(), [](const CpuInfo& a, const CpuInfo& b) {
+    if (a.socket != b.socket) return a.socket < b.socket;
+    if (a.core != b.core) return a.core < b.core;
+    return a.cpu < b.cpu;
+  });
+  for (size_t i = 1; i < topology.cpus_.size(); i++) {
+    const CpuInfo& prev = topology.cpus_[i - 1];
+    CpuInfo& info = topology.cpus_[i];
+    if (info.socket == prev.socket && info.core == prev.core) info.smt_index = prev.smt_index + 1;
+  }
+
+  return topology;
+}
+
+int CpuTopology::NumCores() const {
+  std::set<std::pair<int, int>> cores;
+  for (const CpuInfo& info : cpus_) cores.emplace(info.socket, info.core);
+  return cores.size();
+}
+
+int CpuTopology::NumSockets() const {
+  std::set<int> sockets;
+  for (const CpuInfo& info : cpus_) sockets.insert(info.socket);
+  return sockets.size();
+}
+
+std::vector<int> CpuTopology::Placement(int num_threads, PlacementPolicy policy) const {
+  std::vector<int> placement;
+  if (policy == PlacementPolicy::kNone || cpus_.empty()) return placement;
+
+  std::vector<CpuInfo> order(cpus_);
+  if (policy == PlacementPolicy::kCores) {
+    // All first hardware threads, then all second hardware threads, ...
+    std::stable_sort(order.begin(), order.end(), [](const CpuInfo& a, const CpuInfo& b) {
+      return a.smt_index < b.smt_index;
+    });
+  } else {
+    // Within each socket the cores before their SMT siblings
+    std::stable_sort(order.begin(), order.end(), [](const CpuInfo& a, const CpuInfo& b) {
+      if (a.socket != b.socket) return a.socket < b.socket;
+      return a.smt_index < b.smt_index;
+    });
+  }
+
+  for (int i = 0; i < num_threads; i++) placement.push_back(order[i % order.size()].cpu);
+  return placement;
+}
+
+const CpuInfo* CpuTopology::Find(int cpu) const {
+  for (const CpuInfo& info : cpus_) {
+    if (info.cpu == cpu) return &info;
+  }
+  return nullptr;
+}
+
+bool PinThread(std::thread& thread, int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+void DumpPlacement(FILE* file, const CpuTopology& topology, const std::vector<int>& placement) {
+  fprintf(file, "Topology: %zu cpus, %d cores, %d sockets\n", topology.Cpus().size(),
+          topology.NumCores(), topology.NumSockets());
+  for (size_t i = 0; i < placement.size(); i++) {
+    const CpuInfo* info = topology.Find(placement[i]);
+    if (info == nullptr) {
+      fprintf(file, "  worker %zu: unpinned\n", i);
+    } else {
+      fprintf(file, "  worker %zu: cpu %d (socket %d, core %d, smt %d)\n", i, info->cpu,
+              info->socket, info->core, info->smt_index);
+    }
+  }
+}
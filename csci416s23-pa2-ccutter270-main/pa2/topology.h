@@ -0,0 +1,77 @@
+/**
+ * @file topology.h
+ *
+ * CPU topology discovery (from sysfs on Linux) and thread placement for the task runners
+ */
+#pragma once
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief How to pin worker threads to CPUs
+ */
+enum class PlacementPolicy : int {
+  kNone = 0,  // Leave threads unpinned
+  kCores,     // One thread per physical core (across all sockets) before using SMT siblings
+  kSocket,    // Fill one socket (physical cores, then SMT siblings) before using the next
+};
+
+/**
+ * @brief Location of a single logical CPU
+ */
+struct CpuInfo {
+  int cpu;        // Logical CPU id as used by the scheduler
+  int core;       // Physical core id (unique within a socket)
+  int socket;     // Physical package id
+  int smt_index;  // Position among the hardware threads of the same core
+};
+
+class CpuTopology {
+ public:
+  /**
+   * @brief Discover the CPUs available to this process
+   *
+   * Reads the online CPUs and their core and package ids from sysfs, restricted to the CPUs in
+   * the process's affinity mask (e.g. as limited by a container). If sysfs is not available, each
+   * available CPU is treated as a separate core on a single socket.
+   *
+   * @param sysfs_root Directory with the cpuN/topology entries
+   */
+  static CpuTopology Discover(const std::string& sysfs_root = "/sys/devices/system/cpu");
+
+  const std::vector<CpuInfo>& Cpus() const { return cpus_; }
+  int NumCores() const;
+  int NumSockets() const;
+
+  /**
+   * @brief Choose a CPU for each of num_threads threads
+   * @return Logical CPU ids in thread order (wrapping around if there are more threads than
+   * CPUs), or an empty vector for PlacementPolicy::kNone
+   */
+  std::vector<int> Placement(int num_threads, PlacementPolicy policy) const;
+
+  /**
+   * @brief Look up a logical CPU, returns nullptr if not available to this process
+   */
+  const CpuInfo* Find(int cpu) const;
+
+ private:
+  std::vector<CpuInfo> cpus_;  // Sorted by socket, core and then SMT index
+};
+
+/**
+ * @brief Restrict a thread to run only on the specified logical CPU
+ * @return true if the affinity was set
+ */
+bool PinThread(std::thread& thread, int cpu);
+
+/**
+ * @brief Print the CPU (with socket, core and SMT position) assigned to each worker
+ *
+ * @param file Output file, e.g. stderr
+ * @param topology Topology used to choose the placement
+ * @param placement CPU for each worker, -1 indicates an unpinned worker
+ */
+void DumpPlacement(FILE* file, const CpuTopology& topology, const std::vector<int>& placement);
@@ -0,0 +1,165 @@
+#include "trace.h"
+#include "stats.h"
+
+namespace {
+
+std::atomic<uint64_t> next_tracer_id(1);
+
+// Ring of the tracer the current thread last recorded into, so that a thread only takes the
+// tracer's lock the first time it records or when it alternates between tracers
+struct RingCache {
+  uint64_t tracer;
+  void* ring;
+};
+thread_local RingCache ring_cache = {0, nullptr};
+
+/**
+ * @brief Write str as a JSON string literal
+ */
+void WriteJsonString(FILE* file, const std::string& str) {
+  fputc('"', file);
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      fprintf(file, "\\%c", c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+}  // namespace
+
+TaskTracer::TaskTracer()
+    : id_(next_tracer_id.fetch_add(1, std::memory_order_relaxed)),
+      enabled_(false),
+      next_launch_(0),
+      enable_ns_(0) {}
+
+void TaskTracer::Enable(bool enable) {
+  if (enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& ring : rings_) ring->head.store(0, std::memory_order_relaxed);
+    next_launch_.store(0, std::memory_order_relaxed);
+    enable_ns_ = StatsRecorder::NowNs();
+  }
+  enabled_.store(enable, std::memory_order_release);
+}
+
+void TaskTracer::AddSteal(int worker, int victim) {
+  int64_t now_ns = StatsRecorder::NowNs();
+  Add(TraceEvent{now_ns, now_ns, -1, victim, victim, static_cast<int16_t>(worker), 0,
+                 TraceEvent::Type::kSteal});
+}
+
+TaskTracer::Ring& TaskTracer::ThreadRing() {
+  if (ring_cache.tracer == id_) return *static_cast<Ring*>(ring_cache.ring);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::thread::id self = std::this_thread::get_id();
+  Ring* found = nullptr;
+  for (auto& ring : rings_) {
+    if (ring->owner == self) found = ring.get();
+  }
+  if (found == nullptr) {
+    rings_.emplace_back(new Ring());
+    found = rings_.back().get();
+    found->owner = self;
+    found->events.reset(new TraceEvent[kRingSize]);
+    found->head.store(0, std::memory_order_relaxed);
+  }
+  ring_cache = RingCache{id_, found};
+  return *found;
+}
+
+std::vector<TraceEvent> TaskTracer::Events() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<TraceEvent> events;
+  for (size_t i = 0; i < rings_.size(); i++) {
+    const Ring& ring = *rings_[i];
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    uint64_t first = head > kRingSize ? head - kRingSize : 0;
+    for (uint64_t j = first; j < head; j++) {
+      TraceEvent event = ring.events[j & (kRingSize - 1)];
+      // Events recorded before the last Enable were discarded by resetting the head
+      event.start_ns -= enable_ns_;
+      event.end_ns -= enable_ns_;
+      event.thread = static_cast<int16_t>(i);
+      events.push_back(event);
+    }
+  }
+  return events;
+}
+
+
+bool ChromeTraceWriter::Open(const char* path) {
+  Close();
+  file_ = fopen(path, "w");
+  if (file_ == nullptr) return false;
+  fprintf(file_, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  num_processes_ = 0;
+  first_ = true;
+  return true;
+}
+
+void ChromeTraceWriter::StartEvent() {
+  fprintf(file_, first_ ? "\n" : ",\n");
+  first_ = false;
+}
+
+void ChromeTraceWriter::AddProcess(const std::string& name,
+                                   const std::vector<TraceEvent>& events) {
+  if (file_ == nullptr) return;
+  const int pid = num_processes_++;
+  StartEvent();
+  fprintf(file_, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":", pid);
+  WriteJsonString(file_, name);
+  fprintf(file_, "}}");
+  StartEvent();
+  fprintf(file_, "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%d,\"args\":"
+                 "{\"sort_index\":%d}}", pid, pid);
+
+  // Name each thread's track after the worker of its first event. A thread can act as different
+  // workers (e.g. worker 0 of nested launches), so events also carry their worker.
+  std::vector<bool> named;
+  for (const TraceEvent& event : events) {
+    if (event.thread >= static_cast<int>(named.size())) named.resize(event.thread + 1, false);
+    if (named[event.thread]) continue;
+    named[event.thread] = true;
+    StartEvent();
+    fprintf(file_, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":"
+                   "{\"name\":\"worker %d (thread %d)\"}}", pid, event.thread, event.worker,
+            event.thread);
+  }
+
+  // Timestamps are in microseconds
+  for (const TraceEvent& event : events) {
+    StartEvent();
+    if (event.type == TraceEvent::Type::kSteal) {
+      fprintf(file_, "{\"name\":\"steal\",\"cat\":\"steal\",\"ph\":\"i\",\"s\":\"t\","
+                     "\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"worker\":%d,\"victim\":%d}}",
+              event.start_ns * 1e-3, pid, event.thread, event.worker, event.begin);
+      continue;
+    }
+    if (event.end - event.begin == 1) {
+      fprintf(file_, "{\"name\":\"task %d\"", event.begin);
+    } else {
+      fprintf(file_, "{\"name\":\"tasks %d-%d\"", event.begin, event.end - 1);
+    }
+    fprintf(file_, ",\"cat\":\"launch %d\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,"
+                   "\"tid\":%d,\"args\":{\"launch\":%d,\"worker\":%d,\"begin\":%d,\"end\":%d}}",
+            event.launch, event.start_ns * 1e-3, (event.end_ns - event.start_ns) * 1e-3, pid,
+            event.thread, event.launch, event.worker, event.begin, event.end);
+  }
+}
+
+bool ChromeTraceWriter::Close() {
+  if (file_ == nullptr) return true;
+  fprintf(file_, "\n]}\n");
+  bool ok = ferror(file_) == 0;
+  ok = fclose(file_) == 0 && ok;
+  file_ = nullptr;
+  return ok;
+}
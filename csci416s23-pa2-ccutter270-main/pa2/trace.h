@@ -0,0 +1,141 @@
+/**
+ * @file trace.h
+ *
+ * Opt-in timeline tracing for the task runners, exported as Chrome trace-event JSON
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A range of tasks executed by a worker, or a steal by a worker
+ */
+struct TraceEvent {
+  enum class Type : int8_t { kTasks, kSteal };
+
+  int64_t start_ns;  // Relative to when tracing was enabled
+  int64_t end_ns;    // Equal to start_ns for steals
+  int32_t launch;    // Launch the tasks belong to, -1 if unknown
+  int32_t begin;     // First task, or the victim worker for steals
+  int32_t end;       // One past the last task
+  int16_t worker;
+  int16_t thread;  // Index of the thread that recorded the event, filled in by Events
+  Type type;
+};
+
+/**
+ * @brief Records TraceEvents from multiple threads
+ *
+ * Each thread records into its own fixed-size ring that only it writes, so recording is a clock
+ * read and a couple of plain stores, with no atomic read-modify-write or lock (except the first
+ * time a thread records). Rings keep the most recent kRingSize events of each thread. As with
+ * StatsRecorder, runners check Enabled before reading the clock, so disabled tracing costs a single
+ * load per range of tasks.
+ *
+ * Enable and Events must not race with tasks being executed, e.g. call them between launches.
+ */
+class TaskTracer {
+ public:
+  static constexpr size_t kRingSize = 1 << 16;
+
+  TaskTracer();
+
+  TaskTracer(const TaskTracer&) = delete;
+  TaskTracer& operator=(const TaskTracer&) = delete;
+
+  // Acquire so that a thread that sees tracing enabled also sees the rings reset by Enable
+  bool Enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Start tracing, discarding previously recorded events, or stop tracing
+   */
+  void Enable(bool enable);
+
+  /**
+   * @brief Reserve ids for count launches
+   * @return First of the ids, or -1 if tracing is disabled
+   */
+  int NewLaunch(int count = 1) {
+    if (!Enabled()) return -1;
+    return next_launch_.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Record worker executing tasks [begin, end) of launch between start_ns and end_ns
+   */
+  void AddTasks(int worker, int launch, int begin, int end, int64_t start_ns, int64_t end_ns) {
+    Add(TraceEvent{start_ns, end_ns, launch, begin, end, static_cast<int16_t>(worker), 0,
+                   TraceEvent::Type::kTasks});
+  }
+
+  /**
+   * @brief Record worker stealing work from victim now
+   */
+  void AddSteal(int worker, int victim);
+
+  /**
+   * @brief Copy of the recorded events, oldest first within each thread
+   */
+  std::vector<TraceEvent> Events() const;
+
+ private:
+  struct Ring {
+    std::thread::id owner;
+    std::unique_ptr<TraceEvent[]> events;
+    std::atomic<uint64_t> head;  // Number of events ever recorded, only written by the owner
+  };
+
+  void Add(TraceEvent event) {
+    Ring& ring = ThreadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head & (kRingSize - 1)] = event;
+    ring.head.store(head + 1, std::memory_order_release);
+  }
+
+  Ring& ThreadRing();
+
+  const uint64_t id_;  // Unique for the process, to match the per-thread ring caches
+  std::atomic<bool> enabled_;
+  std::atomic<int> next_launch_;
+  int64_t enable_ns_;
+  mutable std::mutex mutex_;  // Guards rings_
+  std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+/**
+ * @brief Streams traces to a file in the Chrome trace-event format
+ *
+ * Each trace appears as a separate process with one track per recording thread, so the file can be
+ * loaded in chrome://tracing or Perfetto to compare runners side by side.
+ */
+class ChromeTraceWriter {
+ public:
+  ChromeTraceWriter() : file_(nullptr), num_processes_(0), first_(true) {}
+  ~ChromeTraceWriter() { Close(); }
+
+  bool Open(const char* path);
+
+  /**
+   * @brief Append events as a process labeled name
+   */
+  void AddProcess(const std::string& name, const std::vector<TraceEvent>& events);
+
+  /**
+   * @brief Finish the JSON document
+   * @return false if there was an error writing the file
+   */
+  bool Close();
+
+ private:
+  void StartEvent();
+
+  FILE* file_;
+  int num_processes_;
+  bool first_;
+};
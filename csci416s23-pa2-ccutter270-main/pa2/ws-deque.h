@@ -0,0 +1,130 @@
+/**
+ * @file ws-deque.h
+ *
+ * Chase-Lev work-stealing deque, following the C11 formulation in Lê et al., "Correct and
+ * Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Single-owner, multi-thief double-ended queue
+ *
+ * The owning thread pushes and pops at the "bottom" of the deque, while other threads steal
+ * from the "top". Items must be trivially copyable (e.g. task ids).
+ */
+template <typename T>
+class WorkStealingDeque {
+ public:
+  enum class StealResult { kEmpty, kAbort, kSuccess };
+
+  explicit WorkStealingDeque(int64_t capacity = 64) : top_(0), bottom_(0) {
+    int64_t pow2 = 1;
+    while (pow2 < capacity) pow2 <<= 1;
+    retired_.emplace_back(new Buffer(pow2));
+    buffer_.store(retired_.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  /**
+   * @brief Add item at the bottom of the deque (owner only)
+   */
+  void Push(T item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    if (b - t > buffer->capacity - 1) {
+      buffer = Grow(buffer, t, b);
+    }
+    buffer->Put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Remove item from the bottom of the deque (owner only)
+   * @return true if an item was removed
+   */
+  bool Pop(T* item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+
+    if (t > b) {
+      // Deque was already empty
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+
+    *item = buffer->Get(b);
+    if (t == b) {
+      // Last item, race against thieves for it
+      bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed);
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Remove item from the top of the deque (any thread)
+   * @return kSuccess if an item was stolen, kAbort if we lost a race and should retry, and kEmpty
+   * if there was nothing to steal
+   */
+  StealResult Steal(T* item) {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return StealResult::kEmpty;
+
+    Buffer* buffer = buffer_.load(std::memory_order_consume);
+    T value = buffer->Get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      return StealResult::kAbort;
+    *item = value;
+    return StealResult::kSuccess;
+  }
+
+  /**
+   * @brief Approximate number of items in the deque
+   */
+  int64_t Size() const {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    return b > t ? b - t : 0;
+  }
+
+ private:
+  struct Buffer {
+    explicit Buffer(int64_t cap) : capacity(cap), items(new std::atomic<T>[cap]) {}
+
+    T Get(int64_t i) const { return items[i & (capacity - 1)].load(std::memory_order_relaxed); }
+    void Put(int64_t i, T item) { items[i & (capacity - 1)].store(item, std::memory_order_relaxed); }
+
+    int64_t capacity;
+    std::unique_ptr<std::atomic<T>[]> items;
+  };
+
+  Buffer* Grow(Buffer* old, int64_t t, int64_t b) {
+    Buffer* buffer = new Buffer(old->capacity * 2);
+    for (int64_t i = t; i < b; i++) buffer->Put(i, old->Get(i));
+    // Thieves may still be reading from the old buffer so we keep it alive until destruction
+    retired_.emplace_back(buffer);
+    buffer_.store(buffer, std::memory_order_release);
+    return buffer;
+  }
+
+  alignas(64) std::atomic<int64_t> top_;
+  alignas(64) std::atomic<int64_t> bottom_;
+  alignas(64) std::atomic<Buffer*> buffer_;
+  std::vector<std::unique_ptr<Buffer>> retired_;
+};